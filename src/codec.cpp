@@ -0,0 +1,84 @@
+#include "codec.h"
+
+#include <assert.h>
+
+#include "logging.h"
+
+LengthFieldCodec::LengthFieldCodec(const FrameCallback& cb, int headerLen, Endian endian, size_t maxFrameSize)
+    :cb_(cb),
+     headerLen_(headerLen),
+     endian_(endian),
+     maxFrameSize_(maxFrameSize) {
+    assert(headerLen_ == 2 || headerLen_ == 4 || headerLen_ == 8);
+}
+
+bool LengthFieldCodec::peekLength(struct evbuffer *input, uint64_t *len) const {
+    unsigned char header[8];
+    if (evbuffer_copyout(input, header, headerLen_) != headerLen_) {
+        return false;
+    }
+
+    uint64_t value = 0;
+    for (int i = 0; i < headerLen_; ++i) {
+        int idx = endian_ == kBigEndian ? i : headerLen_ - 1 - i;
+        value = (value << 8) | header[idx];
+    }
+    *len = value;
+    return true;
+}
+
+void LengthFieldCodec::encodeLength(uint64_t len, unsigned char *header) const {
+    for (int i = 0; i < headerLen_; ++i) {
+        int idx = endian_ == kBigEndian ? headerLen_ - 1 - i : i;
+        header[idx] = static_cast<unsigned char>(len & 0xff);
+        len >>= 8;
+    }
+}
+
+void LengthFieldCodec::onMessage(const TcpConnPtr& conn, struct evbuffer *input) {
+    //回调中可能关闭连接, 每帧之后都要检查
+    while (conn->getBev() != NULL) {
+        uint64_t len = 0;
+        if (!peekLength(input, &len)) {
+            break;
+        }
+        //超长帧在收到长度头时就拒绝, 不再继续缓存它的body
+        if (len > maxFrameSize_) {
+            log_err("connection:%s frame length %llu exceeds max %zu, close it",
+                    conn->getName().c_str(), (unsigned long long)len, maxFrameSize_);
+            conn->close();
+            return;
+        }
+
+        size_t frameLen = headerLen_ + static_cast<size_t>(len);
+        if (evbuffer_get_length(input) < frameLen) {
+            break;
+        }
+
+        const char *frame = NULL;
+        struct evbuffer_iovec vec;
+        if (evbuffer_peek(input, frameLen, NULL, &vec, 1) == 1 && vec.iov_len >= frameLen) {
+            frame = static_cast<const char *>(vec.iov_base);
+        } else {
+            frame = reinterpret_cast<const char *>(evbuffer_pullup(input, frameLen));
+        }
+        cb_(conn, frame + headerLen_, static_cast<size_t>(len));
+        evbuffer_drain(input, frameLen);
+    }
+}
+
+int LengthFieldCodec::send(const TcpConnPtr& conn, const void *data, size_t len) const {
+    if (len > maxFrameSize_) {
+        log_err("connection:%s frame length %zu exceeds max %zu", conn->getName().c_str(), len, maxFrameSize_);
+        return -1;
+    }
+    unsigned char header[8];
+    encodeLength(len, header);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = headerLen_;
+    iov[1].iov_base = const_cast<void *>(data);
+    iov[1].iov_len = len;
+    return conn->sendv(iov, 2);
+}
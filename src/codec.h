@@ -0,0 +1,51 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdint.h>
+
+#include <functional>
+
+#include "libevent_headers.h"
+#include "tcpconnection.h"
+
+//data指向一个完整帧的body(不含长度头), 只在回调期间有效
+typedef std::function<void(const TcpConnPtr&, const char *data, size_t len)> FrameCallback;
+
+//长度前缀分帧: [长度头][body], 长度头为2/4/8字节, 值为body长度
+//帧在一个chain内时直接回调指向缓冲区的指针, 跨chain时才pullup拼接
+class LengthFieldCodec {
+  public:
+    enum Endian { kBigEndian, kLittleEndian };
+
+    explicit LengthFieldCodec(const FrameCallback& cb,
+                              int headerLen = 4,
+                              Endian endian = kBigEndian,
+                              size_t maxFrameSize = 64 * 1024 * 1024);
+
+    //可直接作为MessageCallBack:
+    //server.setMessageCallback(std::bind(&LengthFieldCodec::onMessage, &codec, std::placeholders::_1, std::placeholders::_2));
+    void onMessage(const TcpConnPtr& conn, struct evbuffer *input);
+
+    //加上长度头后与body一起追加到输出缓冲区
+    int send(const TcpConnPtr& conn, const void *data, size_t len) const;
+
+    int headerLen() const {
+        return headerLen_;
+    }
+
+    size_t maxFrameSize() const {
+        return maxFrameSize_;
+    }
+
+    //从input头部读出body长度, 数据不足一个长度头时返回false, 不消耗数据
+    bool peekLength(struct evbuffer *input, uint64_t *len) const;
+    void encodeLength(uint64_t len, unsigned char *header) const;
+
+  private:
+    FrameCallback cb_;
+    int headerLen_;
+    Endian endian_;
+    size_t maxFrameSize_;
+};
+
+#endif // CODEC_H
@@ -0,0 +1,105 @@
+#ifndef CONNECTIONTABLE_H
+#define CONNECTIONTABLE_H
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "tcpconnection.h"
+
+//基于slot数组的连接表, 插入删除O(1)且不做字符串哈希, 只在所属loop线程内访问
+//连接id布局: 高24位为slot的代数, 中间8位为表的分片号, 低32位为slot下标
+class ConnectionTable {
+  public:
+    explicit ConnectionTable(uint32_t shard = 0)
+        :shard_(shard & 0xff),
+         size_(0) {
+    }
+
+    uint64_t insert(const TcpConnPtr& conn) {
+        uint32_t index;
+        if (!freeSlots_.empty()) {
+            index = freeSlots_.back();
+            freeSlots_.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots_.size());
+            slots_.push_back(Slot());
+        }
+        Slot& slot = slots_[index];
+        slot.conn = conn;
+        ++size_;
+        return makeId(slot.generation, index);
+    }
+
+    bool remove(uint64_t id) {
+        int64_t index = findIndex(id);
+        if (index < 0) {
+            return false;
+        }
+        Slot& slot = slots_[index];
+        slot.conn.reset();
+        //代数递增, 旧id即使slot被复用也不会再命中
+        slot.generation = (slot.generation + 1) & kGenerationMask;
+        freeSlots_.push_back(static_cast<uint32_t>(index));
+        --size_;
+        return true;
+    }
+
+    TcpConnPtr find(uint64_t id) const {
+        int64_t index = findIndex(id);
+        return index < 0 ? TcpConnPtr() : slots_[index].conn;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    //回调中可以关闭连接(remove会清空slot)或插入新连接(slots_可能扩容),
+    //按下标遍历, 每次先拷贝一份引用再回调
+    template <typename Func>
+    void forEach(Func f) const {
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            TcpConnPtr conn = slots_[i].conn;
+            if (conn) {
+                f(conn);
+            }
+        }
+    }
+
+  private:
+    static const uint32_t kGenerationMask = 0xffffff;
+
+    struct Slot {
+        Slot() : generation(0) {}
+
+        TcpConnPtr conn;
+        uint32_t generation;
+    };
+
+    uint64_t makeId(uint32_t generation, uint32_t index) const {
+        return (static_cast<uint64_t>(generation) << 40) | (static_cast<uint64_t>(shard_) << 32) | index;
+    }
+
+    int64_t findIndex(uint64_t id) const {
+        uint32_t index = static_cast<uint32_t>(id & 0xffffffff);
+        if (index >= slots_.size()) {
+            return -1;
+        }
+        const Slot& slot = slots_[index];
+        if (!slot.conn || makeId(slot.generation, index) != id) {
+            return -1;
+        }
+        return index;
+    }
+
+    uint32_t shard_;
+    size_t size_;
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> freeSlots_;
+};
+
+#endif // CONNECTIONTABLE_H
@@ -0,0 +1,179 @@
+#include "dnsresolver.h"
+
+#include <string.h>
+#include <netinet/in.h>
+#include <event2/dns.h>
+
+#include <algorithm>
+
+#include "util.h"
+#include "logging.h"
+
+namespace {
+
+const int kDefaultCacheTtl = 30;
+//一个地址族先有结果后等另一个的时间(RFC 8305的Resolution Delay)
+const char *kFamilySkew = "0.05";
+
+}  // namespace
+
+struct DnsResolver::Lookup {
+    DnsResolver *resolver;
+    std::string host;
+    struct evdns_getaddrinfo_request *req;
+    std::vector<std::pair<int, ResolveCallBack> > waiters;    //端口和回调
+};
+
+DnsResolver::DnsResolver(struct event_base *base)
+    :dns_(evdns_base_new(base, EVDNS_BASE_DISABLE_WHEN_INACTIVE)),
+     customNameserver_(false),
+     cacheTtl_(kDefaultCacheTtl) {
+    //DNS_OPTIONS_ALL包含DNS_OPTION_HOSTSFILE, 同时加载/etc/hosts
+    int ret = evdns_base_resolv_conf_parse(dns_, DNS_OPTIONS_ALL, "/etc/resolv.conf");
+    if (ret != 0) {
+        log_warn("parse resolv.conf failed, ret:%d", ret);
+    }
+    evdns_base_set_option(dns_, "getaddrinfo-allow-skew:", kFamilySkew);
+}
+
+DnsResolver::~DnsResolver() {
+    //取消时在调用栈内以EVUTIL_EAI_CANCEL回调, 回调里只释放查询, 不通知等待者
+    std::map<std::string, Lookup *> lookups;
+    lookups.swap(lookups_);
+    for (auto& it : lookups) {
+        evdns_getaddrinfo_cancel(it.second->req);
+    }
+    evdns_base_free(dns_, 0);
+}
+
+bool DnsResolver::addNameserver(const std::string& address) {
+    if (!customNameserver_) {
+        evdns_base_clear_nameservers_and_suspend(dns_);
+        evdns_base_resume(dns_);
+        customNameserver_ = true;
+    }
+    if (evdns_base_nameserver_ip_add(dns_, address.c_str()) != 0) {
+        log_warn("add nameserver %s failed", address.c_str());
+        return false;
+    }
+    return true;
+}
+
+void DnsResolver::callback(const ResolveCallBack& cb, int err, const std::vector<struct sockaddr_storage>& addrs, int port) {
+    std::vector<struct sockaddr_storage> result(addrs);
+    for (auto& addr : result) {
+        if (addr.ss_family == AF_INET) {
+            ((struct sockaddr_in *)&addr)->sin_port = htons(port);
+        } else {
+            ((struct sockaddr_in6 *)&addr)->sin6_port = htons(port);
+        }
+    }
+    cb(err, result);
+}
+
+void DnsResolver::resolve(const std::string& host, int port, const ResolveCallBack& cb) {
+    struct sockaddr_storage addr;
+    if (util::parse_sockaddr(host, port, &addr)) {
+        cb(0, std::vector<struct sockaddr_storage>(1, addr));
+        return;
+    }
+
+    auto cached = cache_.find(host);
+    if (cached != cache_.end()) {
+        if (cached->second.expire > time(NULL)) {
+            callback(cb, 0, cached->second.addrs, port);
+            return;
+        }
+        cache_.erase(cached);
+    }
+
+    auto it = lookups_.find(host);
+    if (it != lookups_.end()) {
+        it->second->waiters.push_back(std::make_pair(port, cb));
+        return;
+    }
+
+    Lookup *lookup = new Lookup;
+    lookup->resolver = this;
+    lookup->host = host;
+    lookup->req = NULL;
+    lookup->waiters.push_back(std::make_pair(port, cb));
+    lookups_[host] = lookup;
+
+    struct evutil_addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    //命中hosts或立即失败时在调用栈内回调并返回NULL, 此时lookup已释放
+    struct evdns_getaddrinfo_request *req = evdns_getaddrinfo(dns_, host.c_str(), NULL, &hints, dns_cb, lookup);
+    if (req) {
+        lookup->req = req;
+    }
+}
+
+void DnsResolver::dns_cb(int result, struct evutil_addrinfo *res, void *arg) {
+    Lookup *lookup = static_cast<Lookup *>(arg);
+    if (result == EVUTIL_EAI_CANCEL) {
+        if (res) {
+            evutil_freeaddrinfo(res);
+        }
+        delete lookup;
+        return;
+    }
+    lookup->resolver->finish(lookup, result, res);
+}
+
+void DnsResolver::finish(Lookup *lookup, int err, struct evutil_addrinfo *res) {
+    lookups_.erase(lookup->host);
+
+    std::vector<struct sockaddr_storage> v4;
+    std::vector<struct sockaddr_storage> v6;
+    for (struct evutil_addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+        struct sockaddr_storage addr;
+        memset(&addr, 0, sizeof(addr));
+        if (ai->ai_family == AF_INET && ai->ai_addrlen <= sizeof(addr)) {
+            memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+            v4.push_back(addr);
+        } else if (ai->ai_family == AF_INET6 && ai->ai_addrlen <= sizeof(addr)) {
+            memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+            v6.push_back(addr);
+        }
+    }
+    if (res) {
+        evutil_freeaddrinfo(res);
+    }
+
+    std::vector<struct sockaddr_storage> addrs;
+    size_t n = std::max(v4.size(), v6.size());
+    for (size_t i = 0; i < n; ++i) {
+        if (i < v6.size()) {
+            addrs.push_back(v6[i]);
+        }
+        if (i < v4.size()) {
+            addrs.push_back(v4[i]);
+        }
+    }
+
+    if (addrs.empty()) {
+        if (err == 0) {
+            err = EVUTIL_EAI_NONAME;
+        }
+        log_warn("resolve %s failed: %s", lookup->host.c_str(), evutil_gai_strerror(err));
+    } else {
+        err = 0;
+        if (cacheTtl_ > 0) {
+            CacheEntry& entry = cache_[lookup->host];
+            entry.addrs = addrs;
+            entry.expire = time(NULL) + cacheTtl_;
+        }
+    }
+
+    //回调里可能再次发起解析或析构解析器, 先摘下等待者和查询
+    std::vector<std::pair<int, ResolveCallBack> > waiters;
+    waiters.swap(lookup->waiters);
+    delete lookup;
+    for (auto& waiter : waiters) {
+        callback(waiter.second, err, addrs, waiter.first);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef DNSRESOLVER_H
+#define DNSRESOLVER_H
+
+#include <time.h>
+#include <sys/socket.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libevent_headers.h"
+
+struct evdns_base;
+
+//基于evdns_getaddrinfo的异步域名解析, 带进程内缓存, 只能在base所属的loop线程内使用
+//先查/etc/hosts, 再同时查询A和AAAA, 结果按IPv6/IPv4交替排列(IPv6在前), 供调用方依次尝试
+//一个地址族先返回时最多再等另一个50ms, 慢的或超时的一方不会拖住整个解析
+class DnsResolver {
+  public:
+    //err为0表示成功, 否则为EVUTIL_EAI_*(可用evutil_gai_strerror转成字符串); addrs已填入端口
+    typedef std::function<void(int err, const std::vector<struct sockaddr_storage>& addrs)> ResolveCallBack;
+
+    //默认读取/etc/resolv.conf中的服务器和选项
+    explicit DnsResolver(struct event_base *base);
+    //未完成的查询直接丢弃, 不再回调
+    ~DnsResolver();
+
+    DnsResolver(const DnsResolver&) = delete;
+    DnsResolver& operator=(const DnsResolver&) = delete;
+
+    //第一次调用时清掉resolv.conf中的服务器, 之后只用手动添加的, 格式"ip"或"ip:port"
+    bool addNameserver(const std::string& address);
+
+    //缓存命中、数字地址或命中/etc/hosts时在调用栈内直接回调; 同一主机的并发查询合并为一次
+    void resolve(const std::string& host, int port, const ResolveCallBack& cb);
+
+    //getaddrinfo不返回记录的TTL, 解析结果统一缓存seconds秒, 0表示不缓存
+    void setCacheTtl(int seconds) {
+        cacheTtl_ = seconds;
+    }
+
+    void clearCache() {
+        cache_.clear();
+    }
+
+    size_t getCacheSize() const {
+        return cache_.size();
+    }
+
+  private:
+    struct Lookup;
+
+    struct CacheEntry {
+        std::vector<struct sockaddr_storage> addrs;     //端口为0
+        time_t expire;
+    };
+
+    static void dns_cb(int result, struct evutil_addrinfo *res, void *arg);
+    void finish(Lookup *lookup, int err, struct evutil_addrinfo *res);
+    static void callback(const ResolveCallBack& cb, int err, const std::vector<struct sockaddr_storage>& addrs, int port);
+
+    struct evdns_base *dns_;
+    bool customNameserver_;
+    int cacheTtl_;
+    std::map<std::string, CacheEntry> cache_;
+    std::map<std::string, Lookup *> lookups_;
+};
+
+typedef std::shared_ptr<DnsResolver> DnsResolverPtr;
+
+#endif // DNSRESOLVER_H
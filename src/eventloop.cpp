@@ -0,0 +1,168 @@
+#include "eventloop.h"
+
+#include <assert.h>
+
+#include <future>
+
+#include "logging.h"
+#include "eventwatcher.h"
+
+EventLoop::EventLoop()
+    :base_(event_base_new()),
+     ownBase_(true),
+     tid_(std::this_thread::get_id()),
+     notified_(false),
+     pending_functor_count_(0) {
+    if (!base_) {
+        log_err("event_base_new failed");
+    }
+    initWatcher();
+}
+
+EventLoop::EventLoop(struct event_base *base)
+    :base_(base),
+     ownBase_(false),
+     tid_(std::this_thread::get_id()),
+     notified_(false),
+     pending_functor_count_(0) {
+    initWatcher();
+}
+
+EventLoop::~EventLoop() {
+    watcher_.reset();
+    if (ownBase_ && base_) {
+        event_base_free(base_);
+        base_ = NULL;
+    }
+}
+
+void EventLoop::run() {
+    tid_ = std::this_thread::get_id();
+    event_base_dispatch(base_);
+}
+
+void EventLoop::stop() {
+    queueInLoop([this]() {
+        event_base_loopexit(base_, NULL);
+    });
+}
+
+void EventLoop::initWatcher() {
+    watcher_.reset(new LoopWatcher(base_, std::bind(&EventLoop::doPendingFunctors, this)));
+    int rc = watcher_->Init();
+    assert(rc);
+    rc = rc && watcher_->AsyncWait();
+    assert(rc);
+    if (!rc) {
+        log_err("loop watcher init failed");
+    }
+}
+
+void EventLoop::doPendingFunctors() {
+    //先清除标志再取任务, 之后入队的生产者一定会重新唤醒
+    notified_.store(false);
+
+    //只执行进入时已入队的任务, 避免任务中再次queueInLoop导致本轮无法返回
+    int n = pending_functor_count_.load();
+    Functor functor;
+    while (n-- > 0 && pending_functors_.pop(functor)) {
+        functor();
+        functor = nullptr;
+        --pending_functor_count_;
+    }
+
+    if (!pending_functors_.empty() && !notified_.exchange(true)) {
+        watcher_->Notify();
+    }
+}
+
+void EventLoop::drainPendingFunctors() {
+    tid_ = std::this_thread::get_id();
+    Functor functor;
+    while (pending_functors_.pop(functor)) {
+        functor();
+        functor = nullptr;
+        --pending_functor_count_;
+    }
+}
+
+void EventLoop::runInLoop(const Functor& functor) {
+    if (IsInLoopThread()) {
+        functor();
+    } else {
+        queueInLoop(functor);
+    }
+}
+
+void EventLoop::runInLoop(Functor&& functor) {
+    if (IsInLoopThread()) {
+        functor();
+    } else {
+        queueInLoop(std::move(functor));
+    }
+}
+
+void EventLoop::queueInLoop(const Functor& cb) {
+    queueInLoop(Functor(cb));
+}
+
+void EventLoop::queueInLoop(Functor&& cb) {
+    //先计数再入队, 保证计数不会小于队列中的实际任务数
+    ++pending_functor_count_;
+    pending_functors_.push(std::move(cb));
+    //先置位再通知, 避免loop线程在两步之间清除标志导致唤醒丢失
+    if (!notified_.exchange(true)) {
+        watcher_->Notify();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+EventLoopThreadPool::EventLoopThreadPool(int threadNum)
+    :threadNum_(threadNum),
+     started_(false) {
+}
+
+EventLoopThreadPool::~EventLoopThreadPool() {
+    stop();
+    loops_.clear();
+}
+
+void EventLoopThreadPool::start() {
+    if (started_ || !loops_.empty()) {
+        return;
+    }
+    started_ = true;
+
+    for (int i = 0; i < threadNum_; ++i) {
+        EventLoop *loop = new EventLoop();
+        loops_.emplace_back(loop);
+
+        //等待loop线程真正运行起来, 保证tid_对其他线程可见
+        std::promise<void> running;
+        loop->queueInLoop([&running]() {
+            running.set_value();
+        });
+        threads_.emplace_back([loop]() {
+            loop->run();
+        });
+        running.get_future().wait();
+    }
+    log_info("event loop thread pool started, thread num:%d", threadNum_);
+}
+
+void EventLoopThreadPool::stop() {
+    if (!started_) {
+        return;
+    }
+    for (auto& loop : loops_) {
+        loop->stop();
+    }
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+    started_ = false;
+}
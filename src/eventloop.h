@@ -0,0 +1,98 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "libevent_headers.h"
+#include "mpscqueue.h"
+
+typedef std::function<void()> Functor;
+
+#if defined(__linux__)
+class EventFdWatcher;
+typedef EventFdWatcher LoopWatcher;
+#else
+class PipeEventWatcher;
+typedef PipeEventWatcher LoopWatcher;
+#endif
+
+class EventLoop {
+  public:
+    //创建并持有自己的event_base
+    EventLoop();
+    //包装外部传入的event_base, 不负责释放
+    explicit EventLoop(struct event_base *base);
+    ~EventLoop();
+
+    //It MUST be called in the thread which owns this loop.
+    void run();
+    void stop();
+
+    void runInLoop(const Functor &functor);
+    void runInLoop(Functor &&functor);
+    void queueInLoop(const Functor &cb);
+    void queueInLoop(Functor &&cb);
+
+    bool IsInLoopThread() const {
+        return tid_ == std::this_thread::get_id();
+    }
+
+    struct event_base *getBase() const {
+        return base_;
+    }
+
+    //loop线程退出后由当前线程接管, 执行队列中剩余的任务(包括执行过程中新入队的), 用于析构前的清理
+    void drainPendingFunctors();
+
+    //尚未执行的跨线程任务数, 可作为队列深度指标
+    int pendingFunctorCount() const {
+        return pending_functor_count_.load();
+    }
+
+  private:
+    void initWatcher();
+    void doPendingFunctors();
+
+    struct event_base *base_;
+    bool ownBase_;
+
+    std::thread::id tid_;
+    std::shared_ptr<LoopWatcher> watcher_;
+    std::atomic<bool> notified_;
+    MpscQueue<Functor> pending_functors_;
+    std::atomic<int> pending_functor_count_;
+};
+
+class EventLoopThreadPool {
+  public:
+    explicit EventLoopThreadPool(int threadNum);
+    ~EventLoopThreadPool();
+
+    void start();
+    //通知所有loop退出并等待线程结束, loop对象在析构时释放
+    void stop();
+
+    int size() const {
+        return static_cast<int>(loops_.size());
+    }
+
+    EventLoop *getLoop(int index) const {
+        return loops_[index].get();
+    }
+
+    bool isStarted() const {
+        return started_;
+    }
+
+  private:
+    int threadNum_;
+    bool started_;
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+    std::vector<std::thread> threads_;
+};
+
+#endif // EVENTLOOP_H
@@ -5,6 +5,10 @@
 #include <assert.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
 
 #include "libevent_headers.h"
 #include "logging.h"
@@ -109,6 +113,12 @@ failed:
     return false;
 }
 
+//基类析构时DoClose已不再是虚调用, 必须在子类析构中关闭fd
+PipeEventWatcher::~PipeEventWatcher() {
+    FreeEvent();
+    Close();
+}
+
 void PipeEventWatcher::DoClose() {
     if (pipe_[0] > 0) {
         EVUTIL_CLOSESOCKET(pipe_[0]);
@@ -138,3 +148,61 @@ void PipeEventWatcher::Notify() {
         return;
     }
 }
+
+//////////////////////////////////////////////////////////////////////////
+
+#if defined(__linux__)
+EventFdWatcher::EventFdWatcher(struct event_base* event_base,
+                               const Handler& handler)
+    : EventWatcher(event_base, handler), fd_(-1) {
+}
+
+bool EventFdWatcher::DoInit() {
+    assert(fd_ < 0);
+
+    fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd_ < 0) {
+        log_err("create eventfd ERROR errno:%d, errstr:%s", errno, strerror(errno));
+        goto failed;
+    }
+
+    ::event_set(event_, fd_, EV_READ | EV_PERSIST,
+                &EventFdWatcher::HandlerFn, this);
+    return true;
+failed:
+    Close();
+    return false;
+}
+
+EventFdWatcher::~EventFdWatcher() {
+    FreeEvent();
+    Close();
+}
+
+void EventFdWatcher::DoClose() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void EventFdWatcher::HandlerFn(int /*fd*/, short /*which*/, void* v) {
+    EventFdWatcher* e = (EventFdWatcher*)v;
+    eventfd_t count = 0;
+
+    //一次read即可取出并清零所有累积的通知
+    if (::eventfd_read(e->fd_, &count) == 0) {
+        e->handler_();
+    }
+}
+
+bool EventFdWatcher::AsyncWait() {
+    return Watch();
+}
+
+void EventFdWatcher::Notify() {
+    if (::eventfd_write(fd_, 1) < 0) {
+        return;
+    }
+}
+#endif
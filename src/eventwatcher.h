@@ -43,6 +43,7 @@ class EventWatcher {
 class PipeEventWatcher : public EventWatcher {
   public:
     PipeEventWatcher(struct event_base* event_base, const Handler& handler);
+    ~PipeEventWatcher();
 
     bool AsyncWait();
     void Notify();
@@ -57,4 +58,25 @@ class PipeEventWatcher : public EventWatcher {
     int pipe_[2]; // Write to pipe_[0] , Read from pipe_[1]
 };
 
+#if defined(__linux__)
+//与PipeEventWatcher接口一致, 用一个eventfd计数器代替socketpair
+class EventFdWatcher : public EventWatcher {
+  public:
+    EventFdWatcher(struct event_base* event_base, const Handler& handler);
+    ~EventFdWatcher();
+
+    bool AsyncWait();
+    void Notify();
+    int wfd() const {
+        return fd_;
+    }
+  private:
+    virtual bool DoInit();
+    virtual void DoClose();
+    static void HandlerFn(int fd, short which, void* v);
+
+    int fd_;
+};
+#endif
+
 #endif // EVENTWATCHER_H
@@ -0,0 +1,351 @@
+#include "mempool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "libevent_headers.h"
+#include "logging.h"
+
+namespace {
+
+const int kMinShift = 5;                            //最小级32字节
+const int kMaxShift = 16;                           //最大级64K, 覆盖libevent常用的chain尺寸
+const int kClassNum = kMaxShift - kMinShift + 1;
+const uint32_t kLargeClass = 0xffffffff;
+const uint32_t kMagic = 0x45564e54;
+const size_t kChunkSize = 2 * 1024 * 1024;
+const int kBatch = 32;                              //线程缓存与全局池之间每次搬运的块数
+const size_t kMaxCachedBytes = 256 * 1024;          //每个线程每级最多缓存的字节数
+
+//16字节, 保证返回给调用者的地址仍按16字节对齐
+struct BlockHeader {
+    uint32_t cls;
+    uint32_t magic;
+    uint64_t size;
+};
+
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+struct CentralList {
+    std::mutex mutex;
+    FreeBlock *head = NULL;
+};
+
+CentralList g_central[kClassNum];
+std::mutex g_chunkMutex;
+char *g_chunkCur = NULL;
+char *g_chunkEnd = NULL;
+bool g_useHugePages = false;
+
+std::atomic<bool> g_installed(false);
+std::atomic<uint64_t> g_hits(0);
+std::atomic<uint64_t> g_misses(0);
+std::atomic<uint64_t> g_largeAllocs(0);
+std::atomic<uint64_t> g_reservedBytes(0);
+std::atomic<uint64_t> g_hugePageChunks(0);
+
+inline size_t payloadSize(int cls) {
+    return static_cast<size_t>(1) << (cls + kMinShift);
+}
+
+inline size_t blockSize(int cls) {
+    return sizeof(BlockHeader) + payloadSize(cls);
+}
+
+inline size_t maxCached(int cls) {
+    size_t n = kMaxCachedBytes / payloadSize(cls);
+    return n > 2 * kBatch ? n : 2 * kBatch;
+}
+
+inline int classOf(size_t size) {
+    if (size <= payloadSize(0)) {
+        return 0;
+    }
+    int shift = 64 - __builtin_clzl(size - 1);
+    return shift > kMaxShift ? -1 : shift - kMinShift;
+}
+
+char *newChunk() {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (g_useHugePages) {
+        p = mmap(NULL, kChunkSize, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            ++g_hugePageChunks;
+        }
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(NULL, kChunkSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (g_useHugePages) {
+            madvise(p, kChunkSize, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    g_reservedBytes += kChunkSize;
+    return static_cast<char *>(p);
+}
+
+//从chunk切出最多n个块串成链表, 返回实际切出的个数
+int carve(int cls, int n, FreeBlock **head) {
+    size_t bs = blockSize(cls);
+    std::lock_guard<std::mutex> lock(g_chunkMutex);
+    int got = 0;
+    while (got < n) {
+        if (g_chunkCur == NULL || static_cast<size_t>(g_chunkEnd - g_chunkCur) < bs) {
+            //剩余的尾部不足一个块, 直接丢弃
+            char *chunk = newChunk();
+            if (chunk == NULL) {
+                break;
+            }
+            g_chunkCur = chunk;
+            g_chunkEnd = chunk + kChunkSize;
+        }
+        FreeBlock *block = reinterpret_cast<FreeBlock *>(g_chunkCur);
+        g_chunkCur += bs;
+        block->next = *head;
+        *head = block;
+        ++got;
+    }
+    return got;
+}
+
+//从全局池取最多n个块, 不够时从chunk切
+int fetchCentral(int cls, int n, FreeBlock **head) {
+    int got = 0;
+    {
+        CentralList& central = g_central[cls];
+        std::lock_guard<std::mutex> lock(central.mutex);
+        while (got < n && central.head) {
+            FreeBlock *block = central.head;
+            central.head = block->next;
+            block->next = *head;
+            *head = block;
+            ++got;
+        }
+    }
+    if (got < n) {
+        got += carve(cls, n - got, head);
+    }
+    return got;
+}
+
+void releaseCentral(int cls, FreeBlock *first, FreeBlock *last) {
+    CentralList& central = g_central[cls];
+    std::lock_guard<std::mutex> lock(central.mutex);
+    last->next = central.head;
+    central.head = first;
+}
+
+enum CacheState { kCacheUnused, kCacheAlive, kCacheDead };
+
+//平凡类型, 没有析构函数, t_cache析构之后仍可以安全读取
+thread_local int t_cacheState = kCacheUnused;
+
+struct ThreadCache {
+    FreeBlock *head[kClassNum];
+    size_t count[kClassNum];
+    uint64_t hits;
+
+    ThreadCache() : hits(0) {
+        memset(head, 0, sizeof(head));
+        memset(count, 0, sizeof(count));
+        t_cacheState = kCacheAlive;
+    }
+
+    //线程退出时把缓存的块全部还给全局池, 之后本线程的分配和释放直接走全局池
+    ~ThreadCache() {
+        for (int cls = 0; cls < kClassNum; ++cls) {
+            flush(cls, count[cls]);
+        }
+        g_hits += hits;
+        hits = 0;
+        t_cacheState = kCacheDead;
+    }
+
+    void flush(int cls, size_t n) {
+        if (n == 0 || head[cls] == NULL) {
+            return;
+        }
+        FreeBlock *first = head[cls];
+        FreeBlock *last = first;
+        for (size_t i = 1; i < n && last->next; ++i) {
+            last = last->next;
+        }
+        head[cls] = last->next;
+        count[cls] -= n;
+        releaseCentral(cls, first, last);
+    }
+};
+
+thread_local ThreadCache t_cache;
+
+//线程退出过程中(其他thread_local析构时)t_cache可能已经析构, 此时返回NULL
+ThreadCache *threadCache() {
+    if (t_cacheState == kCacheDead) {
+        return NULL;
+    }
+    return &t_cache;
+}
+
+//不是本池分配的指针(如install之前malloc的)没有合法的块头; glibc的malloc块前16字节是块头, 读取是安全的
+bool ownsBlock(const BlockHeader *header) {
+    return header->magic == kMagic && (header->cls < static_cast<uint32_t>(kClassNum) || header->cls == kLargeClass);
+}
+
+void *toUser(FreeBlock *block, uint32_t cls, size_t size) {
+    BlockHeader *header = reinterpret_cast<BlockHeader *>(block);
+    header->cls = cls;
+    header->magic = kMagic;
+    header->size = size;
+    return header + 1;
+}
+
+void *eventMalloc(size_t size) {
+    return MemPool::allocate(size);
+}
+
+void *eventRealloc(void *ptr, size_t size) {
+    return MemPool::reallocate(ptr, size);
+}
+
+void eventFree(void *ptr) {
+    MemPool::deallocate(ptr);
+}
+
+}  // namespace
+
+bool MemPool::install(bool useHugePages) {
+    bool expected = false;
+    if (!g_installed.compare_exchange_strong(expected, true)) {
+        log_warn("mempool already installed");
+        return false;
+    }
+    g_useHugePages = useHugePages;
+    event_set_mem_functions(eventMalloc, eventRealloc, eventFree);
+    log_info("mempool installed, huge pages:%d", (int)useHugePages);
+    return true;
+}
+
+bool MemPool::isInstalled() {
+    return g_installed.load();
+}
+
+MemPoolStats MemPool::getStats() {
+    MemPoolStats stats;
+    stats.hits = g_hits.load();
+    stats.misses = g_misses.load();
+    stats.largeAllocs = g_largeAllocs.load();
+    stats.reservedBytes = g_reservedBytes.load();
+    stats.hugePageChunks = g_hugePageChunks.load();
+    return stats;
+}
+
+void *MemPool::allocate(size_t size) {
+    int cls = classOf(size == 0 ? 1 : size);
+    if (cls < 0) {
+        ++g_largeAllocs;
+        BlockHeader *header = static_cast<BlockHeader *>(malloc(sizeof(BlockHeader) + size));
+        if (header == NULL) {
+            return NULL;
+        }
+        return toUser(reinterpret_cast<FreeBlock *>(header), kLargeClass, size);
+    }
+
+    ThreadCache *cache = threadCache();
+    if (cache == NULL) {
+        FreeBlock *block = NULL;
+        if (fetchCentral(cls, 1, &block) == 0) {
+            return NULL;
+        }
+        return toUser(block, cls, size);
+    }
+    ThreadCache& tc = *cache;
+
+    if (tc.head[cls] == NULL) {
+        ++g_misses;
+        g_hits += tc.hits;
+        tc.hits = 0;
+        tc.count[cls] += fetchCentral(cls, kBatch, &tc.head[cls]);
+        if (tc.head[cls] == NULL) {
+            return NULL;
+        }
+    } else if (++tc.hits >= 256) {
+        //命中计数先在线程内累计, 避免每次分配都做原子操作
+        g_hits += tc.hits;
+        tc.hits = 0;
+    }
+    FreeBlock *block = tc.head[cls];
+    tc.head[cls] = block->next;
+    --tc.count[cls];
+    return toUser(block, cls, size);
+}
+
+void MemPool::deallocate(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    BlockHeader *header = static_cast<BlockHeader *>(ptr) - 1;
+    if (!ownsBlock(header)) {
+        free(ptr);
+        return;
+    }
+    if (header->cls == kLargeClass) {
+        free(header);
+        return;
+    }
+
+    int cls = static_cast<int>(header->cls);
+    FreeBlock *block = reinterpret_cast<FreeBlock *>(header);
+    ThreadCache *cache = threadCache();
+    if (cache == NULL) {
+        releaseCentral(cls, block, block);
+        return;
+    }
+    ThreadCache& tc = *cache;
+    block->next = tc.head[cls];
+    tc.head[cls] = block;
+    //其他线程分配的块也会在这里缓存, 攒多了还一半给全局池
+    if (++tc.count[cls] > maxCached(cls)) {
+        tc.flush(cls, tc.count[cls] / 2);
+    }
+}
+
+void *MemPool::reallocate(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return allocate(size);
+    }
+    if (size == 0) {
+        deallocate(ptr);
+        return NULL;
+    }
+
+    BlockHeader *header = static_cast<BlockHeader *>(ptr) - 1;
+    if (!ownsBlock(header)) {
+        return realloc(ptr, size);
+    }
+    size_t capacity = header->cls == kLargeClass ? header->size : payloadSize(header->cls);
+    if (size <= capacity && header->cls != kLargeClass) {
+        header->size = size;
+        return ptr;
+    }
+
+    void *p = allocate(size);
+    if (p == NULL) {
+        return NULL;
+    }
+    memcpy(p, ptr, header->size < size ? header->size : size);
+    deallocate(ptr);
+    return p;
+}
@@ -0,0 +1,33 @@
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct MemPoolStats {
+    uint64_t hits;            //线程缓存直接命中, 各线程批量汇总, 是近似值
+    uint64_t misses;          //线程缓存为空, 从全局池补充
+    uint64_t largeAllocs;     //超过最大尺寸级, 直接走malloc
+    uint64_t reservedBytes;   //向系统申请的chunk总字节
+    uint64_t hugePageChunks;  //其中以MAP_HUGETLB分配成功的chunk数
+};
+
+//按2的幂分级的内存池, 通过event_set_mem_functions接管libevent的内存分配
+//每个线程缓存各级空闲块, 只有缓存空了或攒多了才访问加锁的全局池; 内存不归还系统
+class MemPool {
+  public:
+    //必须在创建任何event_base/bufferevent之前调用, 只能安装一次
+    //useHugePages为true时chunk优先用MAP_HUGETLB分配, 失败则退回普通页并建议透明大页
+    static bool install(bool useHugePages = false);
+
+    static bool isInstalled();
+
+    static MemPoolStats getStats();
+
+    static void *allocate(size_t size);
+    //不是本池分配的指针(没有合法的块头)分别交给realloc和free
+    static void *reallocate(void *ptr, size_t size);
+    static void deallocate(void *ptr);
+};
+
+#endif // MEMPOOL_H
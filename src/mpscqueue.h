@@ -0,0 +1,70 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+//无锁多生产者单消费者队列(Vyukov算法), push可在任意线程调用, pop只能在唯一的消费者线程调用
+template <typename T>
+class MpscQueue {
+  public:
+    MpscQueue()
+        :head_(new Node()),
+         tail_(head_.load()) {
+    }
+
+    ~MpscQueue() {
+        T value;
+        while (pop(value)) {
+        }
+        delete tail_;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(const T& value) {
+        enqueue(new Node(value));
+    }
+
+    void push(T&& value) {
+        enqueue(new Node(std::move(value)));
+    }
+
+    bool pop(T& value) {
+        Node *tail = tail_;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        value = std::move(next->value);
+        tail_ = next;
+        delete tail;
+        return true;
+    }
+
+    //只在消费者线程调用才有意义
+    bool empty() const {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+  private:
+    struct Node {
+        Node() : next(nullptr) {}
+        explicit Node(const T& v) : value(v), next(nullptr) {}
+        explicit Node(T&& v) : value(std::move(v)), next(nullptr) {}
+
+        T value;
+        std::atomic<Node *> next;
+    };
+
+    void enqueue(Node *node) {
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    std::atomic<Node *> head_;
+    Node *tail_;
+};
+
+#endif // MPSCQUEUE_H
@@ -0,0 +1,72 @@
+#include "objectpool.h"
+
+BlockPool::BlockPool(size_t maxFree)
+    :owner_(std::this_thread::get_id()),
+     blockSize_(0),
+     maxFree_(maxFree),
+     local_(NULL),
+     localCount_(0),
+     remote_(NULL) {
+}
+
+BlockPool::~BlockPool() {
+    Block *lists[2] = { local_, remote_.exchange(NULL) };
+    for (Block *block : lists) {
+        while (block) {
+            Block *next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+    }
+}
+
+void *BlockPool::allocate(size_t size) {
+    if (blockSize_ == 0) {
+        blockSize_ = size < sizeof(Block) ? sizeof(Block) : size;
+    }
+    if (size > blockSize_) {
+        return ::operator new(size);
+    }
+    //不超过块大小的请求都按整块分配, 归还后才能安全地复用
+    if (std::this_thread::get_id() != owner_) {
+        return ::operator new(blockSize_);
+    }
+
+    if (local_ == NULL) {
+        local_ = remote_.exchange(NULL, std::memory_order_acquire);
+        for (Block *b = local_; b; b = b->next) {
+            ++localCount_;
+        }
+    }
+    if (local_ == NULL) {
+        return ::operator new(blockSize_);
+    }
+    Block *block = local_;
+    local_ = block->next;
+    --localCount_;
+    return block;
+}
+
+void BlockPool::deallocate(void *p, size_t size) {
+    if (size > blockSize_) {
+        ::operator delete(p);
+        return;
+    }
+
+    Block *block = static_cast<Block *>(p);
+    if (std::this_thread::get_id() == owner_) {
+        if (localCount_ >= maxFree_) {
+            ::operator delete(p);
+            return;
+        }
+        block->next = local_;
+        local_ = block;
+        ++localCount_;
+        return;
+    }
+
+    Block *head = remote_.load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!remote_.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+}
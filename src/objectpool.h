@@ -0,0 +1,80 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <thread>
+
+//定长内存块的回收池, 只在创建它的线程分配, 可在任意线程归还
+//本线程归还的块直接进本地空闲链表; 其他线程归还的块用CAS压入远端链表, 分配时整条取回, 不存在ABA问题
+class BlockPool {
+  public:
+    explicit BlockPool(size_t maxFree = 1024);
+    ~BlockPool();
+
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    //块大小由第一次分配确定, 之后大小不同的请求直接走operator new
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    size_t freeCount() const {
+        return localCount_;
+    }
+
+  private:
+    struct Block {
+        Block *next;
+    };
+
+    std::thread::id owner_;
+    size_t blockSize_;
+    size_t maxFree_;
+    Block *local_;
+    size_t localCount_;
+    std::atomic<Block *> remote_;
+};
+
+typedef std::shared_ptr<BlockPool> BlockPoolPtr;
+
+//配合std::allocate_shared使用, 对象和控制块一起从池里分配
+//分配器副本存放在控制块里, 持有池的引用, 池一定比从它分配的对象活得久
+template <typename T>
+class PoolAllocator {
+  public:
+    typedef T value_type;
+
+    explicit PoolAllocator(const BlockPoolPtr& pool) : pool_(pool) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : pool_(other.pool_) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(pool_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) {
+        pool_->deallocate(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const {
+        return pool_ == other.pool_;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& other) const {
+        return pool_ != other.pool_;
+    }
+
+  private:
+    template <typename U> friend class PoolAllocator;
+
+    BlockPoolPtr pool_;
+};
+
+#endif // OBJECTPOOL_H
@@ -0,0 +1,252 @@
+#include "pipeline.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include "logging.h"
+
+bool PipelineContext::fireInbound(struct evbuffer *msg) {
+    size_t next = index_ + 1;
+    if (next < pipeline_->stages_.size()) {
+        PipelineContext ctx(pipeline_, conn_, next);
+        return pipeline_->stages_[next]->inbound(ctx, msg);
+    }
+    conn_->deliverMessage(msg);
+    return true;
+}
+
+bool PipelineContext::fireOutbound(struct evbuffer *msg) {
+    if (index_ > 0) {
+        PipelineContext ctx(pipeline_, conn_, index_ - 1);
+        return pipeline_->stages_[index_ - 1]->outbound(ctx, msg);
+    }
+    //移动chain到输出缓冲区, 不拷贝
+    if (conn_->bev_) {
+        evbuffer_add_buffer(bufferevent_get_output(conn_->bev_), msg);
+    }
+    return true;
+}
+
+bool Pipeline::handleRead(const TcpConnPtr& conn, struct evbuffer *input) const {
+    if (stages_.empty()) {
+        conn->deliverMessage(input);
+        return true;
+    }
+    PipelineContext ctx(this, conn, 0);
+    return stages_[0]->inbound(ctx, input);
+}
+
+bool Pipeline::handleWrite(const TcpConnPtr& conn, struct evbuffer *msg) const {
+    if (stages_.empty()) {
+        if (conn->bev_) {
+            evbuffer_add_buffer(bufferevent_get_output(conn->bev_), msg);
+        }
+        return true;
+    }
+    PipelineContext ctx(this, conn, stages_.size() - 1);
+    return stages_.back()->outbound(ctx, msg);
+}
+
+//取msg从skip开始的各段, 不拷贝数据
+static void peekSegments(struct evbuffer *msg, size_t skip, std::vector<struct evbuffer_iovec>& vec) {
+    vec.clear();
+    if (evbuffer_get_length(msg) <= skip) {
+        return;
+    }
+    struct evbuffer_ptr pos;
+    evbuffer_ptr_set(msg, &pos, skip, EVBUFFER_PTR_SET);
+    int n = evbuffer_peek(msg, -1, &pos, NULL, 0);
+    if (n <= 0) {
+        return;
+    }
+    vec.resize(n);
+    evbuffer_peek(msg, -1, &pos, &vec[0], n);
+}
+
+LengthFieldStage::LengthFieldStage(int headerLen, LengthFieldCodec::Endian endian, size_t maxFrameSize)
+    :codec_(FrameCallback(), headerLen, endian, maxFrameSize) {
+}
+
+bool LengthFieldStage::inbound(PipelineContext& ctx, struct evbuffer *msg) {
+    const TcpConnPtr& conn = ctx.conn();
+    struct evbuffer *frame = NULL;
+    bool ok = true;
+    //后续各级可能关闭连接, 每帧之后都要检查
+    while (conn->getBev() != NULL) {
+        uint64_t len = 0;
+        if (!codec_.peekLength(msg, &len)) {
+            break;
+        }
+        if (len > codec_.maxFrameSize()) {
+            log_err("connection:%s frame length %llu exceeds max %zu",
+                    conn->getName().c_str(), (unsigned long long)len, codec_.maxFrameSize());
+            ok = false;
+            break;
+        }
+        if (evbuffer_get_length(msg) < codec_.headerLen() + static_cast<size_t>(len)) {
+            break;
+        }
+
+        if (!frame) {
+            frame = evbuffer_new();
+        }
+        evbuffer_drain(msg, codec_.headerLen());
+        //整块chain直接移动, 只有帧尾所在的chain会拷贝
+        evbuffer_remove_buffer(msg, frame, static_cast<size_t>(len));
+        ok = ctx.fireInbound(frame);
+        evbuffer_drain(frame, evbuffer_get_length(frame));
+        if (!ok) {
+            break;
+        }
+    }
+    if (frame) {
+        evbuffer_free(frame);
+    }
+    return ok;
+}
+
+bool LengthFieldStage::outbound(PipelineContext& ctx, struct evbuffer *msg) {
+    size_t len = evbuffer_get_length(msg);
+    if (len > codec_.maxFrameSize()) {
+        log_err("connection:%s frame length %zu exceeds max %zu",
+                ctx.conn()->getName().c_str(), len, codec_.maxFrameSize());
+        return false;
+    }
+    unsigned char header[8];
+    codec_.encodeLength(len, header);
+    evbuffer_prepend(msg, header, codec_.headerLen());
+    return ctx.fireOutbound(msg);
+}
+
+static uint32_t crc32cOf(struct evbuffer *msg, size_t skip) {
+    std::vector<struct evbuffer_iovec> vec;
+    peekSegments(msg, skip, vec);
+    uint32_t crc = 0;
+    for (auto& v : vec) {
+        crc = util::crc32c(crc, v.iov_base, v.iov_len);
+    }
+    return crc;
+}
+
+bool Crc32cStage::inbound(PipelineContext& ctx, struct evbuffer *msg) {
+    unsigned char header[4];
+    if (evbuffer_copyout(msg, header, 4) != 4) {
+        log_err("connection:%s message too short for crc32c", ctx.conn()->getName().c_str());
+        return false;
+    }
+    uint32_t expect = (uint32_t)header[0] << 24 | (uint32_t)header[1] << 16 | (uint32_t)header[2] << 8 | header[3];
+    uint32_t actual = crc32cOf(msg, 4);
+    if (expect != actual) {
+        log_err("connection:%s crc32c mismatch, expect:%08x actual:%08x",
+                ctx.conn()->getName().c_str(), expect, actual);
+        return false;
+    }
+    evbuffer_drain(msg, 4);
+    return ctx.fireInbound(msg);
+}
+
+bool Crc32cStage::outbound(PipelineContext& ctx, struct evbuffer *msg) {
+    uint32_t crc = crc32cOf(msg, 0);
+    unsigned char header[4] = {
+        static_cast<unsigned char>(crc >> 24), static_cast<unsigned char>(crc >> 16),
+        static_cast<unsigned char>(crc >> 8), static_cast<unsigned char>(crc)
+    };
+    evbuffer_prepend(msg, header, 4);
+    return ctx.fireOutbound(msg);
+}
+
+ZlibStage::ZlibStage(int level, size_t maxInflateSize)
+    :level_(level),
+     maxInflateSize_(maxInflateSize) {
+}
+
+//解压时每次向输出缓冲区预留的空间
+static const size_t kInflateChunk = 16 * 1024;
+
+bool ZlibStage::inbound(PipelineContext& ctx, struct evbuffer *msg) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK) {
+        log_err("inflateInit failed");
+        return false;
+    }
+
+    std::vector<struct evbuffer_iovec> vec;
+    peekSegments(msg, 0, vec);
+    struct evbuffer *out = evbuffer_new();
+    size_t total = 0;
+    int ret = Z_OK;
+    bool ok = true;
+    for (size_t i = 0; i < vec.size() && ok && ret != Z_STREAM_END; ++i) {
+        zs.next_in = static_cast<Bytef *>(vec[i].iov_base);
+        zs.avail_in = static_cast<uInt>(vec[i].iov_len);
+        do {
+            struct evbuffer_iovec space;
+            evbuffer_reserve_space(out, kInflateChunk, &space, 1);
+            zs.next_out = static_cast<Bytef *>(space.iov_base);
+            zs.avail_out = static_cast<uInt>(space.iov_len);
+            ret = inflate(&zs, Z_NO_FLUSH);
+            space.iov_len -= zs.avail_out;
+            evbuffer_commit_space(out, &space, 1);
+            total += space.iov_len;
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                log_err("connection:%s inflate failed, ret:%d", ctx.conn()->getName().c_str(), ret);
+                ok = false;
+            } else if (total > maxInflateSize_) {
+                log_err("connection:%s inflated size exceeds max %zu", ctx.conn()->getName().c_str(), maxInflateSize_);
+                ok = false;
+            }
+        } while (ok && ret != Z_STREAM_END && (zs.avail_in > 0 || zs.avail_out == 0));
+    }
+    inflateEnd(&zs);
+
+    if (ok && ret != Z_STREAM_END) {
+        log_err("connection:%s truncated zlib message", ctx.conn()->getName().c_str());
+        ok = false;
+    }
+    if (ok) {
+        ok = ctx.fireInbound(out);
+    }
+    evbuffer_free(out);
+    return ok;
+}
+
+bool ZlibStage::outbound(PipelineContext& ctx, struct evbuffer *msg) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, level_) != Z_OK) {
+        log_err("deflateInit failed, level:%d", level_);
+        return false;
+    }
+
+    std::vector<struct evbuffer_iovec> vec;
+    peekSegments(msg, 0, vec);
+    //按压缩上界一次预留连续空间, 一遍deflate即可完成
+    struct evbuffer *out = evbuffer_new();
+    struct evbuffer_iovec space;
+    evbuffer_reserve_space(out, deflateBound(&zs, evbuffer_get_length(msg)), &space, 1);
+    zs.next_out = static_cast<Bytef *>(space.iov_base);
+    zs.avail_out = static_cast<uInt>(space.iov_len);
+
+    int ret = Z_OK;
+    size_t i = 0;
+    do {
+        bool last = i + 1 >= vec.size();
+        zs.next_in = i < vec.size() ? static_cast<Bytef *>(vec[i].iov_base) : NULL;
+        zs.avail_in = i < vec.size() ? static_cast<uInt>(vec[i].iov_len) : 0;
+        ret = deflate(&zs, last ? Z_FINISH : Z_NO_FLUSH);
+        ++i;
+    } while (i < vec.size() && ret == Z_OK);
+    space.iov_len -= zs.avail_out;
+    deflateEnd(&zs);
+
+    bool ok = ret == Z_STREAM_END;
+    if (ok) {
+        evbuffer_commit_space(out, &space, 1);
+        ok = ctx.fireOutbound(out);
+    } else {
+        log_err("connection:%s deflate failed, ret:%d", ctx.conn()->getName().c_str(), ret);
+    }
+    evbuffer_free(out);
+    return ok;
+}
@@ -0,0 +1,114 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "libevent_headers.h"
+#include "tcpconnection.h"
+#include "codec.h"
+
+class PipelineStage;
+
+typedef std::shared_ptr<PipelineStage> PipelineStagePtr;
+
+//一次inbound或outbound传递的上下文, 由Pipeline创建, 只在调用期间有效
+class PipelineContext {
+  public:
+    const TcpConnPtr& conn() const {
+        return conn_;
+    }
+
+    //把msg交给下一级, inbound最后一级之后是连接的MessageCallBack, outbound最后一级之后写入连接的输出缓冲区
+    //msg的所有权仍属于调用者, 下一级需要保留数据时应移走chain而不是拷贝
+    bool fireInbound(struct evbuffer *msg);
+    bool fireOutbound(struct evbuffer *msg);
+
+  private:
+    friend class Pipeline;
+
+    PipelineContext(const Pipeline *pipeline, const TcpConnPtr& conn, size_t index)
+        : pipeline_(pipeline), conn_(conn), index_(index) {}
+
+    const Pipeline *pipeline_;
+    const TcpConnPtr& conn_;
+    size_t index_;
+};
+
+//流水线中的一级. 同一个Pipeline会被多个工作loop线程共享, 各级不能保存与连接相关的可变状态
+//返回false表示协议错误, 连接会被关闭
+class PipelineStage {
+  public:
+    virtual ~PipelineStage() {}
+
+    virtual bool inbound(PipelineContext& ctx, struct evbuffer *msg) {
+        return ctx.fireInbound(msg);
+    }
+
+    virtual bool outbound(PipelineContext& ctx, struct evbuffer *msg) {
+        return ctx.fireOutbound(msg);
+    }
+};
+
+//按添加顺序组成inbound方向(连接->用户), outbound方向与之相反(用户->连接)
+//第一级收到的是连接的原始输入流, 通常应为分帧级; 之后每一级收到的都是单条消息
+class Pipeline {
+  public:
+    Pipeline() {}
+
+    Pipeline& addLast(const PipelineStagePtr& stage) {
+        stages_.push_back(stage);
+        return *this;
+    }
+
+    size_t size() const {
+        return stages_.size();
+    }
+
+    //必须在连接所属loop线程内调用
+    bool handleRead(const TcpConnPtr& conn, struct evbuffer *input) const;
+    bool handleWrite(const TcpConnPtr& conn, struct evbuffer *msg) const;
+
+  private:
+    friend class PipelineContext;
+
+    std::vector<PipelineStagePtr> stages_;
+};
+
+//长度前缀分帧, 格式与LengthFieldCodec相同, 帧body以chain移动的方式交给下一级
+class LengthFieldStage : public PipelineStage {
+  public:
+    explicit LengthFieldStage(int headerLen = 4,
+                              LengthFieldCodec::Endian endian = LengthFieldCodec::kBigEndian,
+                              size_t maxFrameSize = 64 * 1024 * 1024);
+
+    virtual bool inbound(PipelineContext& ctx, struct evbuffer *msg);
+    virtual bool outbound(PipelineContext& ctx, struct evbuffer *msg);
+
+  private:
+    LengthFieldCodec codec_;
+};
+
+//消息前加4字节大端CRC32C, 校验直接在evbuffer的各段上计算, 不拷贝
+class Crc32cStage : public PipelineStage {
+  public:
+    virtual bool inbound(PipelineContext& ctx, struct evbuffer *msg);
+    virtual bool outbound(PipelineContext& ctx, struct evbuffer *msg);
+};
+
+//每条消息独立做zlib压缩/解压, maxInflateSize限制解压后的大小防止压缩炸弹
+class ZlibStage : public PipelineStage {
+  public:
+    explicit ZlibStage(int level = -1, size_t maxInflateSize = 64 * 1024 * 1024);
+
+    virtual bool inbound(PipelineContext& ctx, struct evbuffer *msg);
+    virtual bool outbound(PipelineContext& ctx, struct evbuffer *msg);
+
+  private:
+    int level_;
+    size_t maxInflateSize_;
+};
+
+#endif // PIPELINE_H
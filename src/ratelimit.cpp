@@ -0,0 +1,44 @@
+#include "ratelimit.h"
+
+#include "logging.h"
+
+static size_t toRate(size_t rate) {
+    return rate == 0 || rate > static_cast<size_t>(EV_RATE_LIMIT_MAX) ? static_cast<size_t>(EV_RATE_LIMIT_MAX) : rate;
+}
+
+RateLimit::RateLimit(size_t readRate, size_t writeRate, size_t readBurst, size_t writeBurst) {
+    readRate = toRate(readRate);
+    writeRate = toRate(writeRate);
+    readBurst = readBurst < readRate ? readRate : toRate(readBurst);
+    writeBurst = writeBurst < writeRate ? writeRate : toRate(writeBurst);
+    cfg_ = ev_token_bucket_cfg_new(readRate, readBurst, writeRate, writeBurst, NULL);
+    if (!cfg_) {
+        log_err("ev_token_bucket_cfg_new failed, read:%zu/%zu write:%zu/%zu", readRate, readBurst, writeRate, writeBurst);
+    }
+}
+
+RateLimit::~RateLimit() {
+    if (cfg_) {
+        ev_token_bucket_cfg_free(cfg_);
+    }
+}
+
+RateLimitGroup::RateLimitGroup(struct event_base *base, const RateLimitPtr& limit, const std::string& name)
+    :limit_(limit),
+     group_(NULL),
+     name_(name),
+     readThrottled_(0),
+     writeThrottledBytes_(0) {
+    if (limit_ && limit_->cfg()) {
+        group_ = bufferevent_rate_limit_group_new(base, limit_->cfg());
+    }
+    if (!group_) {
+        log_err("create rate limit group %s failed", name_.c_str());
+    }
+}
+
+RateLimitGroup::~RateLimitGroup() {
+    if (group_) {
+        bufferevent_rate_limit_group_free(group_);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "libevent_headers.h"
+
+struct RateLimitStats {
+    uint64_t readThrottled;         //读令牌耗尽导致暂停读取的次数
+    uint64_t writeThrottledBytes;   //追加到输出缓冲区时超出写令牌、需等待令牌才能发出的字节数
+};
+
+//令牌桶配置, rate单位字节/秒, rate为0表示该方向不限速, burst为令牌桶容量, 小于rate时取rate
+//libevent不拷贝配置, 使用它的bufferevent或限速组释放之前配置不能释放, 因此以shared_ptr共享
+class RateLimit {
+  public:
+    RateLimit(size_t readRate, size_t writeRate, size_t readBurst = 0, size_t writeBurst = 0);
+    ~RateLimit();
+
+    RateLimit(const RateLimit&) = delete;
+    RateLimit& operator=(const RateLimit&) = delete;
+
+    const struct ev_token_bucket_cfg *cfg() const {
+        return cfg_;
+    }
+
+  private:
+    struct ev_token_bucket_cfg *cfg_;
+};
+
+typedef std::shared_ptr<RateLimit> RateLimitPtr;
+
+//一个event_base内的限速组, 组内所有连接共享同一个令牌桶, 只能在该base所属的loop线程内使用
+//释放前组内的连接必须已经关闭(连接关闭时会自动退出所在的组)
+class RateLimitGroup {
+  public:
+    RateLimitGroup(struct event_base *base, const RateLimitPtr& limit, const std::string& name = std::string());
+    ~RateLimitGroup();
+
+    RateLimitGroup(const RateLimitGroup&) = delete;
+    RateLimitGroup& operator=(const RateLimitGroup&) = delete;
+
+    struct bufferevent_rate_limit_group *get() const {
+        return group_;
+    }
+
+    const std::string& name() const {
+        return name_;
+    }
+
+    //可在任意线程调用
+    RateLimitStats getStats() const {
+        RateLimitStats stats;
+        stats.readThrottled = readThrottled_.load(std::memory_order_relaxed);
+        stats.writeThrottledBytes = writeThrottledBytes_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void addReadThrottled() {
+        readThrottled_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void addWriteThrottled(size_t bytes) {
+        writeThrottledBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+  private:
+    RateLimitPtr limit_;
+    struct bufferevent_rate_limit_group *group_;
+    std::string name_;
+    std::atomic<uint64_t> readThrottled_;
+    std::atomic<uint64_t> writeThrottledBytes_;
+};
+
+#endif // RATELIMIT_H
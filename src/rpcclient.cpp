@@ -0,0 +1,224 @@
+#include "rpcclient.h"
+
+#include <sys/uio.h>
+
+#include <chrono>
+
+#include "timer.h"
+#include "logging.h"
+
+namespace {
+
+const size_t kIdLen = 8;
+//堆里过期条目超过在途请求数的这个倍数时重建, 避免大量提前完成的请求把堆撑大
+const size_t kCompactFactor = 4;
+const size_t kCompactMinSize = 1024;
+
+void encodeId(uint64_t id, unsigned char *buf) {
+    for (int i = kIdLen - 1; i >= 0; --i) {
+        buf[i] = static_cast<unsigned char>(id & 0xff);
+        id >>= 8;
+    }
+}
+
+}  // namespace
+
+RpcClient::RpcClient(struct event_base *base, const char *name, int checkInterval, size_t maxFrameSize)
+    :client_(base, name, checkInterval),
+     codec_(std::bind(&RpcClient::onFrame, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+            4, LengthFieldCodec::kBigEndian, maxFrameSize),
+     timer_(new Timer(base, std::bind(&RpcClient::onDeadline, this))),
+     nextId_(1),
+     armedDeadline_(0) {
+    client_.setMessageCallback(std::bind(&LengthFieldCodec::onMessage, &codec_, std::placeholders::_1, std::placeholders::_2));
+    client_.setCloseCallback(std::bind(&RpcClient::onClose, this, std::placeholders::_1));
+}
+
+RpcClient::~RpcClient() {
+    client_.close();
+    failAll();
+}
+
+bool RpcClient::connect(const std::string& serverAdress, int port) {
+    return client_.connect(serverAdress, port);
+}
+
+void RpcClient::close() {
+    client_.close();
+    failAll();
+}
+
+int64_t RpcClient::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int RpcClient::sendFrame(const TcpConnPtr& conn, uint64_t id, const void *data, size_t len) {
+    //长度头只有4字节
+    if (len > UINT32_MAX - kIdLen) {
+        log_err("rpc frame length %zu exceeds 4-byte length field", len);
+        return -1;
+    }
+    unsigned char header[4 + kIdLen];
+    uint64_t bodyLen = kIdLen + len;
+    for (int i = 3; i >= 0; --i) {
+        header[i] = static_cast<unsigned char>(bodyLen & 0xff);
+        bodyLen >>= 8;
+    }
+    encodeId(id, header + 4);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<void *>(data);
+    iov[1].iov_len = len;
+    return conn->sendv(iov, len > 0 ? 2 : 1);
+}
+
+bool RpcClient::parseFrame(const char *body, size_t len, uint64_t *id) {
+    if (len < kIdLen) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < kIdLen; ++i) {
+        value = (value << 8) | static_cast<unsigned char>(body[i]);
+    }
+    *id = value;
+    return true;
+}
+
+uint64_t RpcClient::call(const void *data, size_t len, int timeoutMs, const ResponseCallBack& cb) {
+    if (!client_.isConnected()) {
+        log_warn("rpc client %s is not connected", client_.getConn()->getName().c_str());
+        return 0;
+    }
+    if (kIdLen + len > codec_.maxFrameSize()) {
+        log_err("rpc request length %zu exceeds max %zu", len, codec_.maxFrameSize());
+        return 0;
+    }
+
+    uint64_t id = nextId_++;
+    if (sendFrame(client_.getConn(), id, data, len) < 0) {
+        return 0;
+    }
+
+    Pending& pending = pending_[id];
+    pending.cb = cb;
+    pending.deadline = 0;
+    if (timeoutMs > 0) {
+        int64_t now = nowMs();
+        pending.deadline = now + timeoutMs;
+        deadlines_.push(Deadline(pending.deadline, id));
+        if (armedDeadline_ == 0 || pending.deadline < armedDeadline_) {
+            armTimer(now);
+        }
+    }
+    return id;
+}
+
+bool RpcClient::cancel(uint64_t id) {
+    if (pending_.erase(id) == 0) {
+        return false;
+    }
+    compactDeadlines();
+    return true;
+}
+
+void RpcClient::onFrame(const TcpConnPtr& conn, const char *data, size_t len) {
+    uint64_t id = 0;
+    if (!parseFrame(data, len, &id)) {
+        log_err("rpc client %s recv frame without id, close it", conn->getName().c_str());
+        conn->close();
+        return;
+    }
+    auto it = pending_.find(id);
+    if (it == pending_.end()) {
+        //已超时或取消
+        log_info("rpc client %s drop response of request %llu", conn->getName().c_str(), (unsigned long long)id);
+        return;
+    }
+    ResponseCallBack cb;
+    cb.swap(it->second.cb);
+    pending_.erase(it);
+    compactDeadlines();
+    if (cb) {
+        cb(kOk, data + kIdLen, len - kIdLen);
+    }
+}
+
+void RpcClient::onClose(const TcpConnPtr& conn) {
+    failAll();
+    if (closeCallback_) {
+        closeCallback_(conn);
+    }
+}
+
+void RpcClient::onDeadline() {
+    armedDeadline_ = 0;
+    int64_t now = nowMs();
+    std::vector<ResponseCallBack> expired;
+    while (!deadlines_.empty() && deadlines_.top().first <= now) {
+        uint64_t id = deadlines_.top().second;
+        deadlines_.pop();
+        auto it = pending_.find(id);
+        if (it == pending_.end()) {
+            continue;
+        }
+        expired.push_back(std::move(it->second.cb));
+        pending_.erase(it);
+    }
+
+    compactDeadlines();
+    armTimer(now);
+
+    //回调里可能发起新请求, 先整理好堆和定时器再回调
+    for (auto& cb : expired) {
+        if (cb) {
+            cb(kTimeout, NULL, 0);
+        }
+    }
+}
+
+//每次完成或取消都会检查, 重建的代价按被跳过的条目均摊
+void RpcClient::compactDeadlines() {
+    if (deadlines_.size() <= kCompactMinSize || deadlines_.size() <= kCompactFactor * pending_.size()) {
+        return;
+    }
+    std::vector<Deadline> live;
+    for (auto& kv : pending_) {
+        if (kv.second.deadline > 0) {
+            live.push_back(Deadline(kv.second.deadline, kv.first));
+        }
+    }
+    deadlines_ = std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline> >(
+        std::greater<Deadline>(), std::move(live));
+    //最早的截止时间只会变晚, 已设置的定时器最多提前醒来一次
+}
+
+void RpcClient::armTimer(int64_t now) {
+    if (deadlines_.empty()) {
+        armedDeadline_ = 0;
+        timer_->stop();
+        return;
+    }
+    armedDeadline_ = deadlines_.top().first;
+    int64_t delay = armedDeadline_ - now;
+    timer_->addMilliseconds(delay > 0 ? static_cast<int>(delay) : 0);
+}
+
+void RpcClient::failAll() {
+    if (pending_.empty()) {
+        return;
+    }
+    std::unordered_map<uint64_t, Pending> pending;
+    pending.swap(pending_);
+    deadlines_ = std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline> >();
+    armedDeadline_ = 0;
+    timer_->stop();
+    log_warn("rpc client fail %zu in-flight requests", pending.size());
+    for (auto& kv : pending) {
+        if (kv.second.cb) {
+            kv.second.cb(kDisconnected, NULL, 0);
+        }
+    }
+}
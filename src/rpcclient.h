@@ -0,0 +1,96 @@
+#ifndef RPCCLIENT_H
+#define RPCCLIENT_H
+
+#include <stdint.h>
+
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "libevent_headers.h"
+#include "tcpclient.h"
+#include "codec.h"
+
+class Timer;
+
+//单连接上的多路复用请求/响应客户端, 同时可以有任意多个请求在途, 响应按id匹配, 顺序不限
+//帧格式: [4字节大端长度][8字节大端请求id][payload], 长度为id加payload的字节数, 服务端原样带回id
+//每个请求的截止时间放在最小堆里, 只用一个毫秒定时器等待最早的那个; 只能在base所属的loop线程内使用
+class RpcClient {
+  public:
+    enum Status {
+        kOk,
+        kTimeout,        //截止时间内未收到响应, 之后到达的响应被丢弃
+        kDisconnected    //连接断开或客户端关闭, 在途请求立即失败
+    };
+
+    //data只在回调期间有效, 非kOk时为NULL
+    typedef std::function<void(Status status, const char *data, size_t len)> ResponseCallBack;
+
+    RpcClient(struct event_base *base, const char *name, int checkInterval,
+              size_t maxFrameSize = 64 * 1024 * 1024);
+    //在途请求以kDisconnected回调
+    ~RpcClient();
+
+    bool connect(const std::string& serverAdress, int port);
+    //在途请求以kDisconnected回调, 不再重连
+    void close();
+
+    //timeoutMs为0表示不设截止时间; 未连接时不发送也不回调, 返回0, 否则返回请求id
+    uint64_t call(const void *data, size_t len, int timeoutMs, const ResponseCallBack& cb);
+    //取消后不再回调, 已发出的请求的响应到达时被丢弃
+    bool cancel(uint64_t id);
+
+    size_t getPendingCount() const {
+        return pending_.size();
+    }
+
+    bool isConnected() const {
+        return client_.isConnected();
+    }
+
+    //重连、心跳、限速等设置直接作用在底层客户端上, 但不能替换它的消息和关闭回调
+    TcpClient& getClient() {
+        return client_;
+    }
+
+    //连接断开、在途请求都失败之后调用
+    void setCloseCallback(const CloseCallBack& cb) {
+        closeCallback_ = cb;
+    }
+
+    //服务端回复用, 与请求使用同样的帧格式, len超过UINT32_MAX - 8时返回-1
+    static int sendFrame(const TcpConnPtr& conn, uint64_t id, const void *data, size_t len);
+    //从LengthFieldCodec交出的body中取出id, body不足8字节时返回false
+    static bool parseFrame(const char *body, size_t len, uint64_t *id);
+
+  private:
+    struct Pending {
+        ResponseCallBack cb;
+        int64_t deadline;    //0表示不限
+    };
+
+    typedef std::pair<int64_t, uint64_t> Deadline;    //截止时间, 请求id
+
+    void onFrame(const TcpConnPtr& conn, const char *data, size_t len);
+    void onClose(const TcpConnPtr& conn);
+    void onDeadline();
+    void armTimer(int64_t now);
+    void compactDeadlines();
+    void failAll();
+
+    static int64_t nowMs();
+
+    TcpClient client_;
+    LengthFieldCodec codec_;
+    std::unique_ptr<Timer> timer_;
+    uint64_t nextId_;
+    int64_t armedDeadline_;
+    std::unordered_map<uint64_t, Pending> pending_;
+    //已完成或取消的请求不从堆中删除, 到期弹出时发现不在pending_里直接跳过, 过期条目过多时整体重建
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline> > deadlines_;
+    CloseCallBack closeCallback_;
+};
+
+#endif // RPCCLIENT_H
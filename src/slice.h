@@ -0,0 +1,59 @@
+#ifndef SLICE_H
+#define SLICE_H
+
+#include <memory>
+#include <string>
+
+//引用计数的只读数据块, 同一份数据发给多个连接时共享内存而不是逐个拷贝
+//拷贝SharedSlice只增加引用计数, 最后一个引用释放时数据才被释放
+class SharedSlice {
+  public:
+    SharedSlice()
+        :data_(NULL),
+         size_(0) {
+    }
+
+    //接管data的内存, 不拷贝
+    explicit SharedSlice(std::string&& data)
+        :holder_(std::make_shared<const std::string>(std::move(data))),
+         data_(holder_->data()),
+         size_(holder_->size()) {
+    }
+
+    //拷贝一次, 之后的共享不再拷贝
+    SharedSlice(const void *data, size_t len)
+        :holder_(std::make_shared<const std::string>(static_cast<const char *>(data), len)),
+         data_(holder_->data()),
+         size_(holder_->size()) {
+    }
+
+    //与base共享内存的子区间
+    SharedSlice(const SharedSlice& base, size_t offset, size_t len)
+        :holder_(base.holder_),
+         data_(base.data_ + (offset < base.size_ ? offset : base.size_)),
+         size_(offset < base.size_ ? (len < base.size_ - offset ? len : base.size_ - offset) : 0) {
+    }
+
+    const char *data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    long useCount() const {
+        return holder_.use_count();
+    }
+
+  private:
+    std::shared_ptr<const std::string> holder_;
+    const char *data_;
+    size_t size_;
+};
+
+#endif // SLICE_H
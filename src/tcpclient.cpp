@@ -1,69 +1,282 @@
 #include "tcpclient.h"
 
 #include <string.h>
+#include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 
+#include <algorithm>
+
 #include "timer.h"
+#include "util.h"
+#include "eventloop.h"
 #include "logging.h"
 
+namespace {
+
+const int kDefaultRetryInitialMs = 100;
+const int kDefaultConnectTimeoutMs = 3000;
+//前一个地址在这段时间内未建立就并行发起下一个(RFC 8305建议250ms)
+const int kConnectStaggerMs = 250;
+
+}  // namespace
+
 TcpClient::TcpClient(event_base *base, const char *name, int checkInterval)
     :base_(base),
      name_(name),
      connect_(false),
      checkInterval_(checkInterval),
-     connection_(new TcpConnection(base_, -1, name)) {
+     stopped_(false),
+     established_(false),
+     resolving_(false),
+     port_(0),
+     numericHost_(false),
+     addrIndex_(0),
+     resolveGuard_(std::make_shared<int>(0)),
+     loop_(new EventLoop(base)),
+     connection_(TcpConnection::create(loop_.get(), -1, name)),
+     retryInitialMs_(kDefaultRetryInitialMs),
+     retryMaxMs_(std::max(checkInterval * 1000, kDefaultRetryInitialMs)),
+     retryMultiplier_(2.0),
+     retryJitter_(true),
+     connectTimeoutMs_(kDefaultConnectTimeoutMs),
+     reconnectStats_(),
+     rng_(std::random_device()()),
+     handlerInstaller_(NULL),
+     handler_(NULL),
+     sendHeartBeat_(false),
+     heartBeatInterval_(0),
+     invaildInterval_(0),
+     writeLowMark_(0),
+     writeHighMark_(0),
+     pauseReadingOnHighWaterMark_(false),
+     rateGroup_(NULL) {
 
 }
 
 TcpClient::~TcpClient() {
-
+    //打开的连接持有自引用, 必须关闭才会释放
+    close();
 }
 
 bool TcpClient::connect(const std::string &serverAdress, int port) {
-    struct sockaddr_in tSockAddr;
-    memset(&tSockAddr, 0, sizeof(tSockAddr));
-    tSockAddr.sin_family = AF_INET;
-    tSockAddr.sin_addr.s_addr = inet_addr(serverAdress.c_str());
-    tSockAddr.sin_port = htons(port);
+    host_ = serverAdress;
+    port_ = port;
+    addrs_.clear();
+    addrIndex_ = 0;
+    struct sockaddr_storage addr;
+    numericHost_ = util::parse_sockaddr(serverAdress, port, &addr);
+    if (numericHost_) {
+        addrs_.push_back(addr);
+    }
 
-    if( bufferevent_socket_connect(connection_->getBev(), (struct sockaddr*)&tSockAddr, sizeof(tSockAddr)) < 0) {
-        connection_->close();
+    stopped_ = false;
+    if (!timer_) {
+        retryTimer_.reset(new Timer(base_, [this]() {
+            if (!stopped_ && !connect_ && !resolving_) {
+                startConnect();
+            }
+        }));
+        connectTimer_.reset(new Timer(base_, [this]() {
+            onConnectTimeout();
+        }));
+        staggerTimer_.reset(new Timer(base_, [this]() {
+            if (!stopped_ && connect_ && !established_ && addrIndex_ < addrs_.size()) {
+                startAttempt();
+            }
+        }));
+        timer_.reset(new Timer(base_, checkInterval_, [this]() {
+            checkIdle();
+        }));
+    }
+    return startConnect();
+}
+
+bool TcpClient::startConnect() {
+    if (addrIndex_ >= addrs_.size()) {
+        resolveAndConnect();
+        return true;
+    }
+
+    //旧连接还没关闭时先摘掉回调再关, 不能再触发一次失败计数和重连
+    if (reconnectStats_.attempts > 0 && connection_->getBev()) {
+        abandon(connection_);
+    }
+    established_ = false;
+    return startAttempt();
+}
+
+//发起addrIndex_处地址的连接, 之前发起的尝试继续进行, 先建立的胜出
+bool TcpClient::startAttempt() {
+    //第一次使用构造时创建的连接, 之后每次都换一个新的
+    TcpConnPtr conn = reconnectStats_.attempts > 0 ? TcpConnection::create(loop_.get(), -1, name_) : connection_;
+    ++reconnectStats_.attempts;
+
+    const struct sockaddr_storage& addr = addrs_[addrIndex_++];
+    if( bufferevent_socket_connect(conn->getBev(), (struct sockaddr*)&addr, util::sockaddr_len(addr)) < 0) {
+        conn->close();
+        onAttemptFailed(conn);
         return false;
     }
 
+    //连接建立前发送的数据都追加到本轮第一个尝试上, 其他尝试胜出时再转移过去
+    if (attempts_.empty()) {
+        connection_ = conn;
+    }
+    attempts_.push_back(conn);
     connect_ = true;
-    newConnection();
-
-    timer_.reset(new Timer(base_, checkInterval_, [this, tSockAddr]() {
-        if(!connect_) {
-            log_warn("tcpclient connection failed, and begin to retry");
-            connection_.reset(new TcpConnection(base_, -1, name_));
-            if( bufferevent_socket_connect(connection_->getBev(), (struct sockaddr*)&tSockAddr, sizeof(tSockAddr)) < 0) {
-                connection_->close();
-                return;
-            } else {
-                connect_ = true;
-                newConnection();
-            }
+    newConnection(conn);
+    if (addrIndex_ < addrs_.size()) {
+        staggerTimer_->addMilliseconds(kConnectStaggerMs);
+    }
+    if (connectTimeoutMs_ > 0) {
+        connectTimer_->addMilliseconds(connectTimeoutMs_);
+    }
+    return true;
+}
+
+void TcpClient::resolveAndConnect() {
+    if (!resolver_) {
+        resolver_ = std::make_shared<DnsResolver>(base_);
+    }
+    resolving_ = true;
+    std::weak_ptr<int> guard = resolveGuard_;
+    resolver_->resolve(host_, port_, [this, guard](int err, const std::vector<struct sockaddr_storage>& addrs) {
+        if (guard.expired()) {
+            return;
+        }
+        resolving_ = false;
+        if (stopped_) {
+            return;
+        }
+        if (err != 0 || addrs.empty()) {
+            log_warn("tcpclient %s resolve %s failed", name_.c_str(), host_.c_str());
+            ++reconnectStats_.failures;
+            ++reconnectStats_.consecutiveFailures;
+            scheduleReconnect();
+            return;
+        }
+        addrs_ = addrs;
+        addrIndex_ = 0;
+        startConnect();
+    });
+}
+
+//一个尝试未建立就关闭: 还有未发起的地址时立即发起, 不再等错开间隔
+//本轮所有尝试都失败后退避, 域名下一轮重新解析
+void TcpClient::onAttemptFailed(const TcpConnPtr& conn) {
+    ++reconnectStats_.failures;
+    auto it = std::find(attempts_.begin(), attempts_.end(), conn);
+    if (it != attempts_.end()) {
+        attempts_.erase(it);
+    }
+    if (connection_ == conn && !attempts_.empty()) {
+        connection_ = attempts_.front();
+    }
+    if (stopped_) {
+        connect_ = !attempts_.empty();
+        return;
+    }
+    if (addrIndex_ < addrs_.size()) {
+        staggerTimer_->stop();
+        startAttempt();
+        return;
+    }
+    if (!attempts_.empty()) {
+        return;
+    }
+
+    connect_ = false;
+    connectTimer_->stop();
+    //退避按轮计算, 一轮所有地址都失败才算一次连续失败
+    ++reconnectStats_.consecutiveFailures;
+    addrIndex_ = 0;
+    if (!numericHost_) {
+        addrs_.clear();
+    }
+    scheduleReconnect();
+}
+
+void TcpClient::onAttemptConnected(TcpConnection *conn) {
+    auto it = std::find_if(attempts_.begin(), attempts_.end(), [conn](const TcpConnPtr& attempt) {
+        return attempt.get() == conn;
+    });
+    if (it == attempts_.end()) {
+        return;
+    }
+    TcpConnPtr winner = *it;
+    established_ = true;
+    connectTimer_->stop();
+    staggerTimer_->stop();
+    ++reconnectStats_.connects;
+    reconnectStats_.consecutiveFailures = 0;
+    //下次重连从第一个地址开始
+    addrIndex_ = 0;
+
+    std::vector<TcpConnPtr> losers;
+    losers.swap(attempts_);
+    losers.erase(std::find(losers.begin(), losers.end(), winner));
+    if (connection_ != winner && connection_->getBev()) {
+        evbuffer_add_buffer(bufferevent_get_output(winner->getBev()), bufferevent_get_output(connection_->getBev()));
+    }
+    connection_ = winner;
+    for (auto& loser : losers) {
+        abandon(loser);
+    }
+}
+
+//关闭一个不再需要的尝试, 不触发关闭回调和处理对象
+void TcpClient::abandon(const TcpConnPtr& conn) {
+    conn->setCloseCallback(NULL);
+    conn->dispatch_ = NULL;
+    conn->close();
+}
+
+void TcpClient::scheduleReconnect() {
+    if (stopped_ || !retryTimer_) {
+        return;
+    }
+    //断开后的第一次重试不等待, 之后按指数退避, 随机等待避免所有客户端同时重连
+    int delay = 0;
+    int failures = reconnectStats_.consecutiveFailures;
+    if (failures > 0) {
+        double cap = retryInitialMs_;
+        for (int i = 1; i < failures && cap < retryMaxMs_; ++i) {
+            cap *= retryMultiplier_;
+        }
+        int maxDelay = cap < retryMaxMs_ ? static_cast<int>(cap) : retryMaxMs_;
+        if (retryJitter_) {
+            delay = std::uniform_int_distribution<int>(0, maxDelay)(rng_);
         } else {
-            if(time(NULL) - connection_->getActiveTime() > invaildInterval_) {
-                connection_->close();
-
-                log_warn("tcpclient connection timeout, and begin to retry");
-                connection_.reset(new TcpConnection(base_, -1, name_));
-                if( bufferevent_socket_connect(connection_->getBev(), (struct sockaddr*)&tSockAddr, sizeof(tSockAddr)) < 0) {
-                    connection_->close();
-                    return;
-                } else {
-                    connect_ = true;
-                    newConnection();
-                }
-            }
+            delay = maxDelay;
         }
-    }));
+    }
+    log_warn("tcpclient %s reconnect in %d ms, consecutive failures:%d", name_.c_str(), delay, failures);
+    retryTimer_->addMilliseconds(delay);
+}
 
-    return true;
+void TcpClient::onConnectTimeout() {
+    if (!connect_ || established_) {
+        return;
+    }
+    log_warn("tcpclient %s connect timeout after %d ms, %zu attempts in flight", name_.c_str(), connectTimeoutMs_, attempts_.size());
+    //关闭回调里计入失败, 还有地址时继续, 否则安排重连
+    std::vector<TcpConnPtr> attempts(attempts_);
+    reconnectStats_.timeouts += attempts.size();
+    for (auto& conn : attempts) {
+        conn->close();
+    }
+}
+
+void TcpClient::checkIdle() {
+    //未设置超时时间时不做空闲检测, 不开心跳时同样按超时断开重连
+    if (!connect_ || !established_ || invaildInterval_ <= 0) {
+        return;
+    }
+    if(time(NULL) - connection_->getActiveTime() > invaildInterval_) {
+        log_warn("tcpclient connection timeout, and begin to retry");
+        connection_->close();
+    }
 }
 
 int TcpClient::send(const unsigned char *buffer, int size) {
@@ -74,8 +287,32 @@ int TcpClient::send(const unsigned char *buffer, int size) {
     return connection_->send(buffer, size);
 }
 
+int TcpClient::sendFile(int fd, int64_t offset, int64_t length, const SendFileCallBack& cb) {
+    if(!connect_) {
+        log_warn("tcp %s client connection has closed", name_.c_str());
+        ::close(fd);
+        if (cb) {
+            cb(connection_, false);
+        }
+        return -1;
+    }
+    return connection_->sendFile(fd, offset, length, cb);
+}
+
 void TcpClient::close() {
-    connection_->close();
+    stopped_ = true;
+    if (retryTimer_) {
+        retryTimer_->stop();
+        connectTimer_->stop();
+        staggerTimer_->stop();
+    }
+    std::vector<TcpConnPtr> attempts(attempts_);
+    for (auto& conn : attempts) {
+        conn->close();
+    }
+    if (connection_) {
+        connection_->close();
+    }
 }
 
 TcpConnPtr TcpClient::getConn() {
@@ -88,18 +325,69 @@ void TcpClient::setHeartBeat(bool isSendHeartBeat, int sendSeonds, int invaildSe
     invaildInterval_ = invaildSeconds;
 }
 
-void TcpClient::newConnection() {
-    connection_->setConnectionCallback(connectionCallback_);
-    connection_->setMessageCallback(messageCallback_);
-    connection_->setCloseCallback([this](const TcpConnPtr& conn) {
-        connect_ = false;
+void TcpClient::setReconnectBackoff(int initialMs, int maxMs, double multiplier, bool jitter) {
+    retryInitialMs_ = initialMs > 0 ? initialMs : 0;
+    retryMaxMs_ = maxMs > retryInitialMs_ ? maxMs : retryInitialMs_;
+    retryMultiplier_ = multiplier > 1.0 ? multiplier : 1.0;
+    retryJitter_ = jitter;
+}
+
+void TcpClient::setRateLimit(size_t readRate, size_t writeRate, size_t readBurst, size_t writeBurst) {
+    if (readRate == 0 && writeRate == 0) {
+        rateLimit_.reset();
+    } else {
+        rateLimit_ = std::make_shared<RateLimit>(readRate, writeRate, readBurst, writeBurst);
+    }
+    if (connect_) {
+        connection_->setRateLimit(rateLimit_);
+    }
+}
+
+void TcpClient::setRateLimitGroup(RateLimitGroup *group) {
+    rateGroup_ = group;
+    if (connect_) {
+        connection_->setRateLimitGroup(group);
+    }
+}
+
+void TcpClient::newConnection(const TcpConnPtr& conn) {
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setPipeline(pipeline_);
+    if (handlerInstaller_) {
+        handlerInstaller_(conn.get(), handler_);
+    }
+    if (writeLowMark_ > 0 || writeHighMark_ > 0) {
+        conn->setWriteWaterMark(writeLowMark_, writeHighMark_);
+    }
+    conn->setHighWaterMarkCallback(highWaterMark_cb_);
+    conn->setWriteCompleteCallback(writeComplete_cb_);
+    conn->setPauseReadingOnHighWaterMark(pauseReadingOnHighWaterMark_);
+    if (rateLimit_) {
+        conn->setRateLimit(rateLimit_);
+    }
+    if (rateGroup_) {
+        conn->setRateLimitGroup(rateGroup_);
+    }
+    //回调里不能持有conn自身的强引用, 否则连接永远不会释放
+    TcpConnection *raw = conn.get();
+    conn->established_cb_ = [this, raw]() {
+        onAttemptConnected(raw);
+    };
+    conn->setCloseCallback([this](const TcpConnPtr& conn) {
         conn->setState(TcpConnection::kDisconnected);
         if(closeCallback_) {
             closeCallback_(conn);
         }
+        if (established_ && conn == connection_) {
+            connect_ = false;
+            scheduleReconnect();
+        } else {
+            onAttemptFailed(conn);
+        }
     });
-    connection_->setHeartBeatOpt(sendHeartBeat_, heartBeatInterval_);
-    connection_->setHBCallback([this](const TcpConnPtr& conn) {
+    conn->setHeartBeatOpt(sendHeartBeat_, heartBeatInterval_);
+    conn->setHBCallback([this](const TcpConnPtr& conn) {
         if(HBCallback_) {
             HBCallback_(conn);
         }
@@ -2,11 +2,26 @@
 #define TCPCLIENT_H
 
 #include <memory>
+#include <random>
+#include <vector>
+
+#include <sys/socket.h>
 
 #include "libevent_headers.h"
 #include "tcpconnection.h"
+#include "tcphandler.h"
+#include "dnsresolver.h"
 
 class Timer;
+class EventLoop;
+
+struct ReconnectStats {
+    uint64_t attempts;          //发起的连接次数, 包括第一次
+    uint64_t connects;          //成功建立的次数
+    uint64_t failures;          //未建立就关闭的次数, 包括超时
+    uint64_t timeouts;          //其中因连接超时而放弃的次数
+    int consecutiveFailures;    //最近一次建立之后连续失败的轮数, 一轮尝试所有地址
+};
 
 class TcpClient {
   public:
@@ -14,14 +29,51 @@ class TcpClient {
     ~TcpClient();
 
   public:
+    //serverAdress可以是IPv4/IPv6地址、域名, 或"unix:/path"、"unix:@name"(忽略port)
+    //域名经DnsResolver异步解析, 不阻塞loop
+    //解析出多个地址时按顺序发起, 前一个250ms内未建立就并行发起下一个, 先建立的胜出, 其余关闭
+    //一轮所有地址都失败后才退避并重新解析(缓存未过期时不发查询)
+    //发起连接或解析成功返回true, 数字地址连接立即失败时返回false, 之后仍会按退避策略重试
     bool connect(const std::string& serverAdress, int port);
 
+    //多个客户端共享解析器以共享缓存, 未设置时在第一次解析域名时创建
+    void setResolver(const DnsResolverPtr& resolver) {
+        resolver_ = resolver;
+    }
+
     int send(const unsigned char *buffer, int size);
 
+    //见TcpConnection::sendFile, 未连接时直接关闭fd, 以失败回调cb并返回-1
+    int sendFile(int fd, int64_t offset, int64_t length, const SendFileCallBack& cb = SendFileCallBack());
+
+    //关闭当前连接并停止重连, 再次connect后恢复
     void close();
 
     TcpConnPtr getConn();
 
+    //重连退避: 连接断开后立即重试一次, 之后第n次失败等待[0, min(maxMs, initialMs*multiplier^(n-1))]内的随机时间
+    //jitter为false时固定等待上限值; 默认100ms起步, 上限为checkInterval秒
+    void setReconnectBackoff(int initialMs, int maxMs, double multiplier = 2.0, bool jitter = true);
+
+    //最后一次发起连接后timeoutMs毫秒内仍未建立则放弃所有在途的尝试, 0表示不限; 与心跳的空闲超时无关
+    void setConnectTimeout(int timeoutMs) {
+        connectTimeoutMs_ = timeoutMs;
+    }
+
+    ReconnectStats getReconnectStats() const {
+        return reconnectStats_;
+    }
+
+    //连接已建立(收到BEV_EVENT_CONNECTED)且未关闭
+    bool isConnected() const {
+        return connect_ && connection_ && connection_->getState() == TcpConnection::kConnected;
+    }
+
+    //当前连接输出缓冲区中尚未写出的字节数
+    size_t getOutstandingBytes() const {
+        return connection_ ? connection_->getOutputBytes() : 0;
+    }
+
     void setHeartBeat(bool isSendHeartBeat, int sendSeonds, int invaildSeconds);
 
     void setConnectionCallback(const ConnectionCallBack& cb) {
@@ -40,26 +92,104 @@ class TcpClient {
         HBCallback_ = cb;
     }
 
+    //见TcpServer::setWriteWaterMark等, 重连后的新连接沿用同样的设置
+    void setWriteWaterMark(int low, int high) {
+        writeLowMark_ = low;
+        writeHighMark_ = high;
+    }
+    void setHighWaterMarkCallback(const HighWaterMarkCallBack& cb) {
+        highWaterMark_cb_ = cb;
+    }
+    void setWriteCompleteCallback(const WriteCompleteCallBack& cb) {
+        writeComplete_cb_ = cb;
+    }
+    void setPauseReadingOnHighWaterMark(bool pause) {
+        pauseReadingOnHighWaterMark_ = pause;
+    }
+
+    //连接的令牌桶限速(字节/秒, 0表示不限), 重连后的新连接沿用
+    void setRateLimit(size_t readRate, size_t writeRate, size_t readBurst = 0, size_t writeBurst = 0);
+    //与同一个event_base上的其他客户端共享限速组, group须比客户端活得久
+    void setRateLimitGroup(RateLimitGroup *group);
+
+    //见TcpServer::setHandler, 重连后的新连接沿用同一个处理对象
+    template <typename H>
+    void setHandler(H *handler) {
+        handlerInstaller_ = &HandlerDispatch<H>::install;
+        handler_ = handler;
+    }
+
+    //重连后的新连接沿用同一条流水线
+    void setPipeline(const PipelinePtr& pipeline) {
+        pipeline_ = pipeline;
+    }
+
   private:
-    void newConnection();
+    bool startConnect();
+    bool startAttempt();
+    void resolveAndConnect();
+    void onAttemptFailed(const TcpConnPtr& conn);
+    void onAttemptConnected(TcpConnection *conn);
+    void abandon(const TcpConnPtr& conn);
+    void scheduleReconnect();
+    void onConnectTimeout();
+    void checkIdle();
+    void newConnection(const TcpConnPtr& conn);
 
   private:
     struct event_base* base_;
     const std::string name_;
     bool connect_;
     int checkInterval_;
-
+    bool stopped_;
+    bool established_;
+    bool resolving_;
+    std::string host_;
+    int port_;
+    bool numericHost_;
+    std::vector<struct sockaddr_storage> addrs_;
+    size_t addrIndex_;
+    DnsResolverPtr resolver_;
+    //解析回调持有它的弱引用, 客户端析构后回调直接返回
+    std::shared_ptr<int> resolveGuard_;
+
+    std::unique_ptr<EventLoop> loop_;
     TcpConnPtr connection_;
+    //本轮还在连接中的尝试, 建立或失败后移除
+    std::vector<TcpConnPtr> attempts_;
     std::unique_ptr<Timer> timer_;
+    std::unique_ptr<Timer> retryTimer_;
+    std::unique_ptr<Timer> connectTimer_;
+    std::unique_ptr<Timer> staggerTimer_;
+
+    int retryInitialMs_;
+    int retryMaxMs_;
+    double retryMultiplier_;
+    bool retryJitter_;
+    int connectTimeoutMs_;
+    ReconnectStats reconnectStats_;
+    std::minstd_rand rng_;
 
     ConnectionCallBack connectionCallback_;
     MessageCallBack messageCallback_;
     CloseCallBack closeCallback_;
     HeartBeatCallBack HBCallback_;
+    HighWaterMarkCallBack highWaterMark_cb_;
+    WriteCompleteCallBack writeComplete_cb_;
+    HandlerInstaller handlerInstaller_;
+    void *handler_;
+    PipelinePtr pipeline_;
 
     bool sendHeartBeat_;
     int heartBeatInterval_;
     int invaildInterval_;
+
+    int writeLowMark_;
+    int writeHighMark_;
+    bool pauseReadingOnHighWaterMark_;
+
+    RateLimitPtr rateLimit_;
+    RateLimitGroup *rateGroup_;
 };
 
 #endif // TCPCLIENT_H
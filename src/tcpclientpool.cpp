@@ -0,0 +1,154 @@
+#include "tcpclientpool.h"
+
+#include <functional>
+
+#include "util.h"
+#include "logging.h"
+
+TcpClientPool::TcpClientPool(struct event_base *base, const std::string& name, int checkInterval)
+    :base_(base),
+     name_(name),
+     checkInterval_(checkInterval),
+     strategy_(kRoundRobin),
+     next_(0),
+     sendHeartBeat_(false),
+     heartBeatInterval_(0),
+     invaildInterval_(0) {
+}
+
+TcpClientPool::~TcpClientPool() {
+}
+
+void TcpClientPool::addEndpoint(const std::string& ip, int port, int connNum) {
+    for (int i = 0; i < connNum; ++i) {
+        Member member;
+        member.ip = ip;
+        member.port = port;
+        std::string name = name_ + "#" + std::to_string(clients_.size());
+        member.client.reset(new TcpClient(base_, name.c_str(), checkInterval_));
+        clients_.push_back(std::move(member));
+    }
+}
+
+int TcpClientPool::start() {
+    int started = 0;
+    for (auto& member : clients_) {
+        TcpClient *client = member.client.get();
+        client->setConnectionCallback(connectionCallback_);
+        client->setMessageCallback(messageCallback_);
+        client->setCloseCallback(closeCallback_);
+        client->setHBCallback(HBCallback_);
+        client->setHeartBeat(sendHeartBeat_, heartBeatInterval_, invaildInterval_);
+        //域名地址的成员共享一个解析器和它的缓存
+        struct sockaddr_storage addr;
+        if (!util::parse_sockaddr(member.ip, member.port, &addr)) {
+            if (!resolver_) {
+                resolver_ = std::make_shared<DnsResolver>(base_);
+            }
+            client->setResolver(resolver_);
+        }
+        if (client->connect(member.ip, member.port)) {
+            ++started;
+        } else {
+            log_warn("client pool %s connect %s:%d failed", name_.c_str(), member.ip.c_str(), member.port);
+        }
+    }
+    return started;
+}
+
+void TcpClientPool::close() {
+    for (auto& member : clients_) {
+        member.client->close();
+    }
+}
+
+void TcpClientPool::setHeartBeat(bool isSendHeartBeat, int sendSeconds, int invaildSeconds) {
+    sendHeartBeat_ = isSendHeartBeat;
+    heartBeatInterval_ = sendSeconds;
+    invaildInterval_ = invaildSeconds;
+}
+
+int TcpClientPool::getConnectedNum() const {
+    int n = 0;
+    for (auto& member : clients_) {
+        if (member.client->isConnected()) {
+            ++n;
+        }
+    }
+    return n;
+}
+
+TcpClient *TcpClientPool::pickFrom(size_t start) {
+    size_t n = clients_.size();
+    for (size_t i = 0; i < n; ++i) {
+        TcpClient *client = clients_[(start + i) % n].client.get();
+        if (client->isConnected()) {
+            return client;
+        }
+    }
+    return NULL;
+}
+
+TcpClient *TcpClientPool::pickRoundRobin() {
+    if (clients_.empty()) {
+        return NULL;
+    }
+    TcpClient *client = pickFrom(next_ % clients_.size());
+    ++next_;
+    return client;
+}
+
+TcpClient *TcpClientPool::pickLeastOutstanding() {
+    TcpClient *best = NULL;
+    size_t bestBytes = 0;
+    //从轮询位置开始扫描, 待发字节相同时在成员间轮换
+    size_t n = clients_.size();
+    for (size_t i = 0; i < n; ++i) {
+        TcpClient *client = clients_[(next_ + i) % n].client.get();
+        if (!client->isConnected()) {
+            continue;
+        }
+        size_t bytes = client->getOutstandingBytes();
+        if (!best || bytes < bestBytes) {
+            best = client;
+            bestBytes = bytes;
+            if (bytes == 0) {
+                break;
+            }
+        }
+    }
+    ++next_;
+    return best;
+}
+
+TcpClient *TcpClientPool::pick() {
+    if (strategy_ == kLeastOutstanding) {
+        return pickLeastOutstanding();
+    }
+    return pickRoundRobin();
+}
+
+TcpClient *TcpClientPool::pick(const std::string& key) {
+    if (strategy_ != kStickyByKey || clients_.empty()) {
+        return pick();
+    }
+    return pickFrom(std::hash<std::string>()(key) % clients_.size());
+}
+
+int TcpClientPool::send(const unsigned char *buffer, int size) {
+    TcpClient *client = pick();
+    if (!client) {
+        log_warn("client pool %s has no connected member", name_.c_str());
+        return 0;
+    }
+    return client->send(buffer, size);
+}
+
+int TcpClientPool::send(const std::string& key, const unsigned char *buffer, int size) {
+    TcpClient *client = pick(key);
+    if (!client) {
+        log_warn("client pool %s has no connected member", name_.c_str());
+        return 0;
+    }
+    return client->send(buffer, size);
+}
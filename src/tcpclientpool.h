@@ -0,0 +1,96 @@
+#ifndef TCPCLIENTPOOL_H
+#define TCPCLIENTPOOL_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libevent_headers.h"
+#include "tcpclient.h"
+
+//到一个或多个后端的一组TcpClient, 每次发送按策略挑选一个已连接的成员
+//断开的成员由TcpClient自身的定时器在后台重连; 只能在base所属的loop线程内使用
+class TcpClientPool {
+  public:
+    enum Strategy {
+        kRoundRobin,        //轮询
+        kLeastOutstanding,  //输出缓冲区中待发字节最少
+        kStickyByKey        //按key哈希固定到同一个成员, 该成员断开时顺延到下一个
+    };
+
+    TcpClientPool(struct event_base *base, const std::string& name, int checkInterval);
+    ~TcpClientPool();
+
+    //每个地址建立connNum个连接, 须在start之前调用, ip也可以是域名
+    void addEndpoint(const std::string& ip, int port, int connNum = 1);
+    //为所有成员设置回调并发起连接, 返回发起成功的成员数
+    int start();
+    void close();
+
+    void setStrategy(Strategy strategy) {
+        strategy_ = strategy;
+    }
+
+    //无可用连接时返回0
+    int send(const unsigned char *buffer, int size);
+    //kStickyByKey策略下同一个key总是落到同一个成员, 其他策略忽略key
+    int send(const std::string& key, const unsigned char *buffer, int size);
+
+    //按策略挑选一个已连接的成员, 没有时返回NULL
+    TcpClient *pick();
+    TcpClient *pick(const std::string& key);
+
+    size_t size() const {
+        return clients_.size();
+    }
+    int getConnectedNum() const;
+
+    //以下设置在start时应用到所有成员
+    void setHeartBeat(bool isSendHeartBeat, int sendSeconds, int invaildSeconds);
+
+    void setConnectionCallback(const ConnectionCallBack& cb) {
+        connectionCallback_ = cb;
+    }
+
+    void setMessageCallback(const MessageCallBack& cb) {
+        messageCallback_ = cb;
+    }
+
+    void setCloseCallback(const CloseCallBack& cb) {
+        closeCallback_ = cb;
+    }
+
+    void setHBCallback(const HeartBeatCallBack& cb) {
+        HBCallback_ = cb;
+    }
+
+  private:
+    struct Member {
+        std::string ip;
+        int port;
+        std::unique_ptr<TcpClient> client;
+    };
+
+    TcpClient *pickRoundRobin();
+    TcpClient *pickLeastOutstanding();
+    TcpClient *pickFrom(size_t start);
+
+    struct event_base *base_;
+    std::string name_;
+    int checkInterval_;
+    Strategy strategy_;
+    size_t next_;
+    std::vector<Member> clients_;
+    DnsResolverPtr resolver_;
+
+    ConnectionCallBack connectionCallback_;
+    MessageCallBack messageCallback_;
+    CloseCallBack closeCallback_;
+    HeartBeatCallBack HBCallback_;
+
+    bool sendHeartBeat_;
+    int heartBeatInterval_;
+    int invaildInterval_;
+};
+
+#endif // TCPCLIENTPOOL_H
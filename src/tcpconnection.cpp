@@ -4,38 +4,79 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
 #include "logging.h"
+#include "eventloop.h"
+#include "pipeline.h"
+#include "tcphandler.h"
 
-TcpConnection::TcpConnection(struct event_base *base, evutil_socket_t fd, const std::string &name)
-    :fd_(fd),
-     name_(name),
+TcpConnection::TcpConnection(EventLoop *loop, evutil_socket_t fd, const std::string &name)
+    :name_(name),
+     id_(0),
+     loop_(loop),
+     fd_(fd),
      state_(kConnecting),
+     dispatch_(NULL),
+     handler_(NULL),
+     activeTime_(time(NULL)),
+     heartBeatTime_(0),
      sendHeartBeat_(false),
-     activeTime_(time(NULL)) {
-    log_info("get connection name:%s, fd:%d", name_.c_str(), fd);
+     heartBeatInterval_(0),
+     idleTimeout_(0),
+     writeHighMark_(0),
+     pauseReadingOnHighWaterMark_(false),
+     readingPaused_(false),
+     shutdownPending_(false),
+     writeShutdown_(false),
+     rateGroup_(NULL) {
+    rateStats_.readThrottled = 0;
+    rateStats_.writeThrottledBytes = 0;
+    log_info("get connection fd:%d", fd);
 
     if(fd > 0) {
         evutil_make_socket_nonblocking(fd);
     }
 
 
-    bev_ = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE|BEV_OPT_THREADSAFE);
+    //连接只在所属loop线程内操作, 不需要bufferevent和evbuffer的锁
+    bev_ = bufferevent_socket_new(loop_->getBase(), fd, BEV_OPT_CLOSE_ON_FREE);
     if(bev_ == NULL) {
         log_err("bufferevent_socket_new failed, err: %s", strerror(errno));
     }
-    bufferevent_setcb(bev_, read_cb, NULL, event_cb, static_cast<void *>(this));
+    bufferevent_setcb(bev_, read_cb, write_cb, event_cb, static_cast<void *>(this));
     bufferevent_enable(bev_, EV_TIMEOUT | EV_READ | EV_WRITE | EV_PERSIST);
-
-    struct evbuffer *output = bufferevent_get_output(bev_);
-    evbuffer_enable_locking(output, NULL);
+    //所有追加到输出缓冲区的路径(send/sendv/流水线/文件)都经过这里检查高水位
+    evbuffer_add_cb(bufferevent_get_output(bev_), output_cb, static_cast<void *>(this));
 }
 
 TcpConnection::~TcpConnection() {
-    log_info("connection %s delete", name_.c_str());
+    log_info("connection id:%llu fd:%d delete", (unsigned long long)id_, fd_);
+}
+
+TcpConnPtr TcpConnection::create(EventLoop *loop, evutil_socket_t fd, const std::string &name, const BlockPoolPtr& pool) {
+    TcpConnPtr conn;
+    if (pool) {
+        conn = std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(pool), loop, fd, name);
+    } else {
+        conn = std::make_shared<TcpConnection>(loop, fd, name);
+    }
+    if (conn->bev_) {
+        conn->self_ = conn;
+    }
+    return conn;
+}
+
+std::string TcpConnection::getName() const {
+    if (name_.empty()) {
+        name_ = "server" + util::get_peer_ip(fd_) + "#" + std::to_string(id_);
+    }
+    return name_;
 }
 
 std::string TcpConnection::getRemoteAddress() const {
-    return util::get_peer_ip(fd_) + ":" + std::to_string(util::get_peer_port(fd_));
+    return util::get_peer_addr(fd_);
 }
 
 void TcpConnection::setReadWaterMark(int low, int high) {
@@ -43,6 +84,7 @@ void TcpConnection::setReadWaterMark(int low, int high) {
 }
 
 void TcpConnection::setWriteWaterMark(int low, int high) {
+    writeHighMark_ = high > 0 ? high : 0;
     bufferevent_setwatermark(bev_, EV_WRITE, low, high);
 }
 
@@ -53,33 +95,408 @@ void TcpConnection::setHeartBeatOpt(bool isSendHeartBeat, int interval) {
     bufferevent_set_timeouts( bev_, &tTimeout, NULL);
 }
 
+void TcpConnection::setTimingWheelOpt(bool isSendHeartBeat, int heartBeatInterval, int idleTimeout) {
+    sendHeartBeat_ = isSendHeartBeat;
+    heartBeatInterval_ = heartBeatInterval;
+    idleTimeout_ = idleTimeout;
+}
+
+void TcpConnection::setRateLimit(const RateLimitPtr& limit) {
+    if (!bev_) {
+        return;
+    }
+    //先设置新配置再替换旧的, 保证bufferevent引用的配置一直有效
+    bufferevent_set_rate_limit(bev_, limit ? const_cast<struct ev_token_bucket_cfg *>(limit->cfg()) : NULL);
+    rateLimit_ = limit;
+}
+
+void TcpConnection::setRateLimitGroup(RateLimitGroup *group) {
+    if (!bev_) {
+        return;
+    }
+    if (group && group->get()) {
+        bufferevent_add_to_rate_limit_group(bev_, group->get());
+        rateGroup_ = group;
+    } else {
+        bufferevent_remove_from_rate_limit_group(bev_);
+        rateGroup_ = NULL;
+    }
+}
+
+void TcpConnection::checkReadThrottled() {
+    //本次读完后已没有读令牌, libevent会暂停读取直到令牌补充
+    if (bev_ && bufferevent_get_max_to_read(bev_) <= 0) {
+        ++rateStats_.readThrottled;
+        if (rateGroup_) {
+            rateGroup_->addReadThrottled();
+        }
+    }
+}
+
+void TcpConnection::checkWriteThrottled(size_t len, size_t added) {
+    ev_ssize_t allowed = bufferevent_get_max_to_write(bev_);
+    size_t excess = allowed > 0 ? (len > static_cast<size_t>(allowed) ? len - allowed : 0) : len;
+    size_t throttled = excess < added ? excess : added;
+    if (throttled > 0) {
+        rateStats_.writeThrottledBytes += throttled;
+        if (rateGroup_) {
+            rateGroup_->addWriteThrottled(throttled);
+        }
+    }
+}
+
 void TcpConnection::close() {
-    onClose();
+    if (loop_->IsInLoopThread()) {
+        onClose();
+    } else {
+        loop_->queueInLoop(std::bind(&TcpConnection::onClose, shared_from_this()));
+    }
+}
+
+void TcpConnection::shutdown() {
+    if (loop_->IsInLoopThread()) {
+        shutdownInLoop();
+    } else {
+        loop_->queueInLoop(std::bind(&TcpConnection::shutdownInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::shutdownInLoop() {
+    if (!bev_ || shutdownPending_) {
+        return;
+    }
+    shutdownPending_ = true;
+    //还有待发数据时等write_cb里缓冲区清空后再关闭写方向
+    if (evbuffer_get_length(bufferevent_get_output(bev_)) == 0) {
+        shutdownWrite();
+    }
+}
+
+void TcpConnection::shutdownWrite() {
+    evutil_socket_t fd = bufferevent_getfd(bev_);
+    if (fd >= 0 && ::shutdown(fd, SHUT_WR) != 0) {
+        log_warn("connection:%s shutdown failed, err: %s", getName().c_str(), strerror(errno));
+    }
+    writeShutdown_ = true;
 }
 
 int TcpConnection::send(const unsigned char *buffer, int size) {
-    if(bev_) {
-        bufferevent_lock(bev_);
-        struct evbuffer *output = bufferevent_get_output(bev_);
-        evbuffer_lock(output);
-        evbuffer_add(output, buffer, size);
-        evbuffer_unlock(output);
+    if (loop_->IsInLoopThread()) {
+        if (!bev_) {
+            return 0;
+        }
+        sendInLoop(buffer, size);
         return size;
     }
+
+    //跨线程发送需先拷贝数据, 再交给所属loop写入
+    std::string data(reinterpret_cast<const char *>(buffer), size);
+    loop_->queueInLoop(std::bind(&TcpConnection::sendStringInLoop, shared_from_this(), std::move(data)));
+    return size;
+}
+
+void TcpConnection::sendInLoop(const void *data, size_t len) {
+    if (bev_) {
+        evbuffer_add(bufferevent_get_output(bev_), data, len);
+    }
+}
+
+void TcpConnection::sendStringInLoop(const std::string &data) {
+    sendInLoop(data.data(), data.size());
+}
+
+//小于该长度的数据直接拷贝, 比额外分配一个引用chain更便宜
+static const size_t kMinReferenceSize = 256;
+
+int TcpConnection::send(const SharedSlice &slice) {
+    if (loop_->IsInLoopThread()) {
+        if (!bev_) {
+            return 0;
+        }
+        sendSliceInLoop(slice);
+    } else {
+        loop_->queueInLoop(std::bind(&TcpConnection::sendSliceInLoop, shared_from_this(), slice));
+    }
+    return static_cast<int>(slice.size());
+}
+
+void TcpConnection::sendSliceInLoop(const SharedSlice &slice) {
+    if (!bev_ || slice.empty()) {
+        return;
+    }
+    struct evbuffer *output = bufferevent_get_output(bev_);
+    if (slice.size() < kMinReferenceSize) {
+        evbuffer_add(output, slice.data(), slice.size());
+        return;
+    }
+    SharedSlice *ref = new SharedSlice(slice);
+    if (evbuffer_add_reference(output, ref->data(), ref->size(), releaseSlice, ref) != 0) {
+        delete ref;
+    }
+}
+
+int TcpConnection::sendv(const struct iovec *iov, int iovcnt, bool *overHighWaterMark) {
+    if (overHighWaterMark) {
+        *overHighWaterMark = false;
+    }
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        total += iov[i].iov_len;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    if (!loop_->IsInLoopThread()) {
+        std::string data;
+        data.reserve(total);
+        for (int i = 0; i < iovcnt; ++i) {
+            data.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+        }
+        loop_->queueInLoop(std::bind(&TcpConnection::sendStringInLoop, shared_from_this(), std::move(data)));
+        return static_cast<int>(total);
+    }
+
+    if (!bev_) {
+        return 0;
+    }
+    //预留一段连续空间, 各段直接拷进去后一次提交
+    struct evbuffer *output = bufferevent_get_output(bev_);
+    struct evbuffer_iovec vec;
+    if (evbuffer_reserve_space(output, total, &vec, 1) != 1) {
+        log_err("connection:%s reserve %zu bytes failed", getName().c_str(), total);
+        return 0;
+    }
+    char *p = static_cast<char *>(vec.iov_base);
+    for (int i = 0; i < iovcnt; ++i) {
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+    vec.iov_len = total;
+    evbuffer_commit_space(output, &vec, 1);
+
+    if (overHighWaterMark) {
+        *overHighWaterMark = isOverHighWaterMark();
+    }
+    return static_cast<int>(total);
+}
+
+int TcpConnection::sendv(const SharedSlice *slices, int count, bool *overHighWaterMark) {
+    if (overHighWaterMark) {
+        *overHighWaterMark = false;
+    }
+    size_t total = 0;
+    for (int i = 0; i < count; ++i) {
+        total += slices[i].size();
+    }
+
+    if (!loop_->IsInLoopThread()) {
+        std::vector<SharedSlice> copy(slices, slices + count);
+        loop_->queueInLoop(std::bind(&TcpConnection::sendSlicesInLoop, shared_from_this(), std::move(copy)));
+        return static_cast<int>(total);
+    }
+
+    if (!bev_) {
+        return 0;
+    }
+    for (int i = 0; i < count; ++i) {
+        sendSliceInLoop(slices[i]);
+    }
+    if (overHighWaterMark) {
+        *overHighWaterMark = isOverHighWaterMark();
+    }
+    return static_cast<int>(total);
+}
+
+void TcpConnection::sendSlicesInLoop(const std::vector<SharedSlice> &slices) {
+    for (auto& slice : slices) {
+        sendSliceInLoop(slice);
+    }
+}
+
+bool TcpConnection::isOverHighWaterMark() const {
+    size_t high = 0;
+    if (!bev_ || bufferevent_getwatermark(bev_, EV_WRITE, NULL, &high) != 0 || high == 0) {
+        return false;
+    }
+    return evbuffer_get_length(bufferevent_get_output(bev_)) > high;
+}
+
+int TcpConnection::sendMessage(const void *data, size_t len) {
+    if (!pipeline_) {
+        return send(static_cast<const unsigned char *>(data), static_cast<int>(len));
+    }
+    if (loop_->IsInLoopThread()) {
+        return sendMessageInLoop(data, len);
+    }
+    std::string copy(static_cast<const char *>(data), len);
+    loop_->queueInLoop(std::bind(&TcpConnection::sendMessageStringInLoop, shared_from_this(), std::move(copy)));
+    return static_cast<int>(len);
+}
+
+int TcpConnection::sendMessageInLoop(const void *data, size_t len) {
+    if (!bev_) {
+        return 0;
+    }
+    //各级可能把chain直接移入输出缓冲区, 这里必须拷贝而不能引用调用者的内存
+    PipelinePtr pipeline = pipeline_;
+    if (!pipeline) {
+        sendInLoop(data, len);
+        return static_cast<int>(len);
+    }
+    struct evbuffer *msg = evbuffer_new();
+    evbuffer_add(msg, data, len);
+    bool ok = pipeline->handleWrite(shared_from_this(), msg);
+    evbuffer_free(msg);
+    return ok ? static_cast<int>(len) : -1;
+}
+
+void TcpConnection::sendMessageStringInLoop(const std::string &data) {
+    sendMessageInLoop(data.data(), data.size());
+}
+
+struct SendFileContext {
+    TcpConnWeakPtr conn;
+    SendFileCallBack cb;
+};
+
+int TcpConnection::sendFile(int fd, int64_t offset, int64_t length, const SendFileCallBack& cb) {
+    if (fd < 0) {
+        return -1;
+    }
+    if (loop_->IsInLoopThread()) {
+        sendFileInLoop(fd, offset, length, cb);
+    } else {
+        loop_->queueInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fd, offset, length, cb));
+    }
     return 0;
 }
 
+void TcpConnection::sendFileInLoop(int fd, int64_t offset, int64_t length, const SendFileCallBack& cb) {
+    if (!bev_) {
+        ::close(fd);
+        if (cb) {
+            cb(self_ ? self_ : shared_from_this(), false);
+        }
+        return;
+    }
+
+    //libevent在length为-1时按整个文件长度计算而忽略offset, 这里自己算出剩余长度
+    if (length < 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            length = st.st_size > offset ? st.st_size - offset : 0;
+        }
+    }
+
+    struct evbuffer_file_segment *seg = evbuffer_file_segment_new(fd, offset, length, EVBUF_FS_CLOSE_ON_FREE);
+    if (!seg) {
+        log_err("connection:%s create file segment failed, fd:%d", getName().c_str(), fd);
+        ::close(fd);
+        if (cb) {
+            cb(self_, false);
+        }
+        return;
+    }
+    if (evbuffer_add_file_segment(bufferevent_get_output(bev_), seg, 0, -1) != 0) {
+        log_err("connection:%s add file segment failed, fd:%d", getName().c_str(), fd);
+        //此时没有注册回收回调, free只关闭fd, 由这里报告失败
+        evbuffer_file_segment_free(seg);
+        if (cb) {
+            cb(self_, false);
+        }
+        return;
+    }
+    if (cb) {
+        //segment已被输出缓冲区引用, 在数据写完或输出缓冲区释放时回收, 此时回调
+        evbuffer_file_segment_add_cleanup_cb(seg, sendFileDone, new SendFileContext{shared_from_this(), cb});
+    }
+    evbuffer_file_segment_free(seg);
+}
+
+void TcpConnection::sendFileDone(struct evbuffer_file_segment const * /*seg*/, int /*flags*/, void *arg) {
+    SendFileContext *ctx = static_cast<SendFileContext *>(arg);
+    TcpConnPtr conn = ctx->conn.lock();
+    //onClose先置空bev_再释放, 因连接关闭而回收的segment视为未写完
+    ctx->cb(conn, conn && conn->bev_ != NULL);
+    delete ctx;
+}
+
+void TcpConnection::releaseSlice(const void * /*data*/, size_t /*len*/, void *extra) {
+    delete static_cast<SharedSlice *>(extra);
+}
+
 void TcpConnection::read_cb(struct bufferevent *bev, void *ctx) {
     log_trace("bufferevent read cb");
     TcpConnection *self = static_cast<TcpConnection *>(ctx);
-    struct evbuffer *input = bufferevent_get_input(self->bev_);
-    size_t n = evbuffer_get_length(input);
-    if(n > 0) {
+    //回调里关闭连接可能导致self被释放, 之后不能再访问self
+    struct evbuffer *input = self->beginRead();
+    if (input) {
         self->onMessage(input);
-    } else {
-        self->close();
     }
-    self->setActiveTime(time(NULL));
+}
+
+struct evbuffer *TcpConnection::beginRead() {
+    struct evbuffer *input = bufferevent_get_input(bev_);
+    size_t n = evbuffer_get_length(input);
+    setActiveTime(time(NULL));
+    if (isRateLimited()) {
+        checkReadThrottled();
+    }
+    //已关闭写方向, 无法再回应, 收到的数据直接丢弃
+    if (n > 0 && writeShutdown_) {
+        evbuffer_drain(input, n);
+        return NULL;
+    }
+    if (n == 0) {
+        close();
+        return NULL;
+    }
+    return input;
+}
+
+void TcpConnection::write_cb(struct bufferevent *bev, void *ctx) {
+    //输出缓冲区已降到写低水位
+    TcpConnection *self = static_cast<TcpConnection *>(ctx);
+    if (self->shutdownPending_ && !self->writeShutdown_ && evbuffer_get_length(bufferevent_get_output(bev)) == 0) {
+        self->shutdownWrite();
+    }
+    if (self->readingPaused_) {
+        self->readingPaused_ = false;
+        bufferevent_enable(bev, EV_READ);
+    }
+    if (self->writeComplete_cb_ && self->self_) {
+        self->writeComplete_cb_(self->self_);
+    }
+}
+
+void TcpConnection::output_cb(struct evbuffer * /*buffer*/, const struct evbuffer_cb_info *info, void *ctx) {
+    TcpConnection *self = static_cast<TcpConnection *>(ctx);
+    if (info->n_added == 0 || !self->bev_) {
+        return;
+    }
+    size_t len = info->orig_size + info->n_added - info->n_deleted;
+    if (self->isRateLimited()) {
+        self->checkWriteThrottled(len, info->n_added);
+    }
+    size_t high = self->writeHighMark_;
+    if (high == 0 || info->orig_size > high || len <= high) {
+        return;
+    }
+    if (self->pauseReadingOnHighWaterMark_ && !self->readingPaused_) {
+        self->readingPaused_ = true;
+        bufferevent_disable(self->bev_, EV_READ);
+    }
+    //此时还在evbuffer操作内部, 用户回调推迟执行, 以便回调里安全地关闭或继续发送
+    if (self->highWaterMark_cb_) {
+        self->loop_->queueInLoop(std::bind(&TcpConnection::onHighWaterMark, self->shared_from_this(), len));
+    }
+}
+
+void TcpConnection::onHighWaterMark(size_t len) {
+    if (bev_ && highWaterMark_cb_) {
+        highWaterMark_cb_(self_, len);
+    }
 }
 
 void TcpConnection::event_cb(struct bufferevent *bev, short sEvent, void *ctx) {
@@ -107,32 +524,88 @@ void TcpConnection::event_cb(struct bufferevent *bev, short sEvent, void *ctx) {
         if(self->getSendHeartBeat()) {
             self->onHeartBeat();
         }
-        bufferevent_enable(bev, EV_TIMEOUT | EV_READ | EV_WRITE | EV_PERSIST);
+        bufferevent_enable(bev, self->readingPaused_ ? EV_WRITE : (EV_READ | EV_WRITE));
 
         struct timeval tTimeout = {self->getHeartBeatInterval(), 0};
         bufferevent_set_timeouts( bev, &tTimeout, NULL);
     }
 }
 
+//销毁时释放连接的自引用
+struct TcpConnection::SelfRelease {
+    explicit SelfRelease(TcpConnection *c) : conn(c) {}
+    ~SelfRelease() {
+        conn->releaseSelf();
+    }
+    TcpConnection *conn;
+};
+
 void TcpConnection::onClose() {
-    log_warn("%s close connection", name_.c_str());
-    bufferevent_free(bev_);
+    if (!bev_) {
+        return;
+    }
+    log_info("connection id:%llu fd:%d close", (unsigned long long)id_, fd_);
+    struct bufferevent *bev = bev_;
     bev_ = NULL;
+    //bufferevent可能延迟释放, 先退出限速组, 之后组可以安全释放
+    if (rateGroup_) {
+        bufferevent_remove_from_rate_limit_group(bev);
+        rateGroup_ = NULL;
+    }
+    bufferevent_free(bev);
+    if (!self_) {
+        TcpConnPtr conn = shared_from_this();
+        if (dispatch_) {
+            dispatch_(handler_, kHandlerClose, conn, NULL);
+        }
+        if(close_cb_) {
+            close_cb_(conn);
+        }
+        return;
+    }
+    if (dispatch_) {
+        dispatch_(handler_, kHandlerClose, self_, NULL);
+    }
     if(close_cb_) {
-        close_cb_(shared_from_this());
+        close_cb_(self_);
     }
+    //调用栈上的回调可能还在使用self_, 自引用推迟到下一轮再释放
+    //loop已退出时任务随队列一起销毁, 同样会释放
+    std::shared_ptr<SelfRelease> release(new SelfRelease(this));
+    loop_->queueInLoop([release]() {});
+}
+
+void TcpConnection::releaseSelf() {
+    TcpConnPtr self;
+    self.swap(self_);
 }
 
 void TcpConnection::onMessage(evbuffer* input) {
-    if(message_cb_) {
-        message_cb_(shared_from_this(), input);
+    if (pipeline_) {
+        //回调中可能替换流水线, 持有一份引用直到本次处理结束
+        PipelinePtr pipeline = pipeline_;
+        if (!pipeline->handleRead(self_, input)) {
+            close();
+        }
+        return;
+    }
+    deliverMessage(input);
+}
+
+void TcpConnection::deliverMessage(evbuffer* input) {
+    if (dispatch_) {
+        dispatch_(handler_, kHandlerMessage, self_, input);
+    } else if(message_cb_) {
+        message_cb_(self_, input);
     }
 }
 
 void TcpConnection::onHeartBeat() {
     if(bev_) {
-        if(heartBeat_cb_) {
-            heartBeat_cb_(shared_from_this());
+        if (dispatch_) {
+            dispatch_(handler_, kHandlerHeartBeat, self_, NULL);
+        } else if(heartBeat_cb_) {
+            heartBeat_cb_(self_);
         }
     }
 }
@@ -143,8 +616,17 @@ void TcpConnection::setState(const State &state) {
 
 void TcpConnection::onConnectionEstablished() {
     state_ = kConnected;
-    if(connection_cb_) {
-        connection_cb_(shared_from_this());
+    //未经create创建的连接在这里补上自引用
+    if (!self_ && bev_) {
+        self_ = shared_from_this();
+    }
+    if (established_cb_) {
+        established_cb_();
+    }
+    if (dispatch_) {
+        dispatch_(handler_, kHandlerConnection, self_, NULL);
+    } else if(connection_cb_) {
+        connection_cb_(self_);
     }
 }
 
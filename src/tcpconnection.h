@@ -3,35 +3,78 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
+
+#include <sys/uio.h>
 
 #include "libevent_headers.h"
 
 #include "util.h"
+#include "slice.h"
+#include "objectpool.h"
+#include "ratelimit.h"
 
 class TcpServer;
 class TcpClient;
 class TcpConnection;
+class TimingWheel;
+class EventLoop;
+class Pipeline;
+template <typename H> struct HandlerDispatch;
 
 typedef std::shared_ptr<TcpConnection>                                                   TcpConnPtr;
 typedef std::weak_ptr<TcpConnection>                                                     TcpConnWeakPtr;
 typedef std::function<void(const TcpConnPtr&)>                                           ConnectionCallBack;
 typedef std::function<void(const TcpConnPtr&, struct evbuffer*)>                         MessageCallBack;
 typedef std::function<void(const TcpConnPtr&)>                                           WriteCompleteCallBack;
+typedef std::function<void(const TcpConnPtr&, size_t)>                                   HighWaterMarkCallBack;
 typedef std::function<void(const TcpConnPtr&)>                                           CloseCallBack;
 typedef std::function<void(const TcpConnPtr&)>                                           HeartBeatCallBack;
+typedef std::function<void(const TcpConnPtr&, bool)>                                     SendFileCallBack;
+typedef std::shared_ptr<Pipeline>                                                        PipelinePtr;
 
 
 class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
     friend class TcpServer;
     friend class TcpClient;
+    friend class TimingWheel;
+    friend class Pipeline;
+    friend class PipelineContext;
+    template <typename H> friend struct HandlerDispatch;
   public:
-    TcpConnection(struct event_base *base, evutil_socket_t fd, const std::string& name);
+    TcpConnection(EventLoop *loop, evutil_socket_t fd, const std::string& name);
     ~TcpConnection();
 
+    //pool非空时对象和控制块从该池分配, 池只能在loop线程使用
+    //池只回收TcpConnection对象本身, bufferevent和两个evbuffer仍按连接分配, 由MemPool::install接管的分配器复用
+    //打开期间连接持有自身的引用, 各回调直接传这个引用, 不再每次调用shared_from_this
+    //自引用只在关闭(close或对端断开)时释放, create出来的连接必须保证最终被关闭, 否则对象和池块都不会释放
+    //用户只有在跨线程保存连接时才需要拷贝TcpConnPtr
+    static TcpConnPtr create(EventLoop *loop, evutil_socket_t fd, const std::string& name,
+                             const BlockPoolPtr& pool = BlockPoolPtr());
+
   public:
     enum State { kDisconnected, kConnecting, kConnected, kDisconnecting };
+    //可在任意线程调用, 非所属loop线程的调用会被转交到所属loop执行
     void close();
+    //输出缓冲区全部写出后关闭写方向(SHUT_WR), 之后收到的数据直接丢弃, 等待对端关闭连接
+    //可在任意线程调用
+    void shutdown();
+    bool isWriteShutdown() const {
+        return writeShutdown_;
+    }
     int send(const unsigned char *buffer, int size);
+    //以引用方式挂到输出缓冲区, 数据在内核写完后才释放引用, 不拷贝
+    int send(const SharedSlice& slice);
+    //多段数据一次追加到输出缓冲区(只拷贝一次, 共享数据块不拷贝), 返回追加的总字节数
+    //overHighWaterMark非空时返回追加后是否超过写高水位, 跨线程调用时无法得知, 固定为false
+    int sendv(const struct iovec *iov, int iovcnt, bool *overHighWaterMark = NULL);
+    int sendv(const SharedSlice *slices, int count, bool *overHighWaterMark = NULL);
+    //用sendfile发送文件的[offset, offset+length)区间, length为-1表示到文件末尾, 接管fd(发送结束后关闭)
+    //文件数据全部写出或连接关闭时回调, 第二个参数表示是否完整写出
+    int sendFile(int fd, int64_t offset, int64_t length, const SendFileCallBack& cb = SendFileCallBack());
+    //经过流水线outbound各级处理后发送, 未设置流水线时等同send
+    int sendMessage(const void *data, size_t len);
 
   public:
     std::string getRemoteAddress() const;
@@ -40,8 +83,15 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
         return fd_;
     }
 
-    std::string getName() const {
-        return name_;
+    //服务端连接的名字在首次使用时才生成, 避免accept路径上的getpeername和字符串拼接
+    std::string getName() const;
+
+    uint64_t getId() const {
+        return id_;
+    }
+
+    void setId(uint64_t id) {
+        id_ = id;
     }
 
     void setActiveTime(int64_t time) {
@@ -63,7 +113,19 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
         return bev_;
     }
 
+    EventLoop *getLoop() const {
+        return loop_;
+    }
+
     void setState(const State &state);
+    State getState() const {
+        return state_;
+    }
+
+    //输出缓冲区中尚未写出的字节数, 只能在所属loop线程调用
+    size_t getOutputBytes() const {
+        return bev_ ? evbuffer_get_length(bufferevent_get_output(bev_)) : 0;
+    }
 
     void setMessageCallback(MessageCallBack cb) {
         message_cb_ = cb;
@@ -79,22 +141,93 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
         heartBeat_cb_ = cb;
     }
 
+    //输出缓冲区降到写低水位(默认0, 即全部写出)时回调
+    void setWriteCompleteCallback(WriteCompleteCallBack cb) {
+        writeComplete_cb_ = cb;
+    }
+    //输出缓冲区从写高水位以下涨到高水位以上时回调一次, 第二个参数为当前待发字节数
+    //回调推迟到本轮事件处理结束后执行, 不会在send内部重入
+    void setHighWaterMarkCallback(HighWaterMarkCallBack cb) {
+        highWaterMark_cb_ = cb;
+    }
+    //超过写高水位时停止读取对端数据, 降到写低水位后恢复
+    void setPauseReadingOnHighWaterMark(bool pause) {
+        pauseReadingOnHighWaterMark_ = pause;
+    }
+    bool isReadingPaused() const {
+        return readingPaused_;
+    }
+
+    //单个连接的令牌桶限速, 传空取消; 只能在所属loop线程调用
+    void setRateLimit(const RateLimitPtr& limit);
+    //加入限速组与组内其他连接共享令牌, 传NULL退出; 组必须属于同一个loop
+    void setRateLimitGroup(RateLimitGroup *group);
+    RateLimitStats getRateLimitStats() const {
+        return rateStats_;
+    }
+
+    //设置静态分发的处理对象, 设置后不再调用连接/消息/心跳的std::function回调, 定义见tcphandler.h
+    template <typename H>
+    void setHandler(H *handler);
+
+    //设置后输入数据先经流水线inbound各级处理, 最后一级输出的每条消息再回调MessageCallBack
+    void setPipeline(const PipelinePtr& pipeline) {
+        pipeline_ = pipeline;
+    }
+    const PipelinePtr& getPipeline() const {
+        return pipeline_;
+    }
+
     void setReadWaterMark(int low, int high);
+    //high为0表示不检查高水位
     void setWriteWaterMark(int low, int high);
 
     void setHeartBeatOpt(bool isSendHeartBeat, int interval);
+    //心跳和空闲超时交由所属loop的时间轮检查, 不再设置bufferevent读超时
+    void setTimingWheelOpt(bool isSendHeartBeat, int heartBeatInterval, int idleTimeout);
 
   private:
+    //处理对象的低频事件经按处理类型实例化的分发函数转发, 消息由按类型实例化的read_cb直接调用
+    enum HandlerEvent { kHandlerConnection, kHandlerMessage, kHandlerHeartBeat, kHandlerClose };
+    typedef void (*HandlerDispatchFn)(void *handler, HandlerEvent event, const TcpConnPtr& conn, struct evbuffer *input);
+
     static void read_cb(struct bufferevent *bev, void *ctx);
-    //static void write_cb( struct bufferevent * bev, void * ctx );
+    //read_cb的公共部分, 返回需要交给上层的输入缓冲区, 数据被丢弃或连接已关闭时返回NULL
+    struct evbuffer *beginRead();
+    static void write_cb(struct bufferevent *bev, void *ctx);
     static void event_cb(struct bufferevent *bev, short sEvent, void *ctx);
+    static void output_cb(struct evbuffer *buffer, const struct evbuffer_cb_info *info, void *ctx);
+
+    void shutdownInLoop();
+    void shutdownWrite();
+    void sendInLoop(const void *data, size_t len);
+    void sendStringInLoop(const std::string& data);
+    void sendSliceInLoop(const SharedSlice& slice);
+    void sendSlicesInLoop(const std::vector<SharedSlice>& slices);
+    int sendMessageInLoop(const void *data, size_t len);
+    void sendMessageStringInLoop(const std::string& data);
+    bool isOverHighWaterMark() const;
+    static void releaseSlice(const void *data, size_t len, void *extra);
+    struct SelfRelease;
+    void releaseSelf();
+    void sendFileInLoop(int fd, int64_t offset, int64_t length, const SendFileCallBack& cb);
+    static void sendFileDone(struct evbuffer_file_segment const *seg, int flags, void *arg);
 
     void onConnectionEstablished();
     void onClose();
     void onMessage(evbuffer *input);
+    void deliverMessage(evbuffer *input);
     void onHeartBeat();
+    void onHighWaterMark(size_t len);
+    bool isRateLimited() const {
+        return rateLimit_ || rateGroup_;
+    }
+    void checkReadThrottled();
+    void checkWriteThrottled(size_t len, size_t added);
 
-    std::string name_;
+    mutable std::string name_;
+    uint64_t id_;
+    EventLoop *loop_;
     evutil_socket_t fd_;
     State state_;
 
@@ -102,12 +235,32 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
     ConnectionCallBack connection_cb_;
     CloseCallBack close_cb_;
+    //TcpClient用来感知连接建立, 不受setHandler影响
+    std::function<void()> established_cb_;
     MessageCallBack message_cb_;
     HeartBeatCallBack heartBeat_cb_;
+    WriteCompleteCallBack writeComplete_cb_;
+    HighWaterMarkCallBack highWaterMark_cb_;
+    HandlerDispatchFn dispatch_;
+    void *handler_;
+    PipelinePtr pipeline_;
+    TcpConnPtr self_;
 
     int64_t activeTime_;
+    int64_t heartBeatTime_;
     bool sendHeartBeat_;
     int heartBeatInterval_;
+    int idleTimeout_;
+
+    size_t writeHighMark_;
+    bool pauseReadingOnHighWaterMark_;
+    bool readingPaused_;
+    bool shutdownPending_;
+    bool writeShutdown_;
+
+    RateLimitPtr rateLimit_;
+    RateLimitGroup *rateGroup_;
+    RateLimitStats rateStats_;
 };
 
 #endif // TCPCONNECTION_H
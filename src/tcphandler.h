@@ -0,0 +1,69 @@
+#ifndef TCPHANDLER_H
+#define TCPHANDLER_H
+
+#include "libevent_headers.h"
+#include "tcpconnection.h"
+
+//按处理类型实例化的分发代码, 处理对象的成员函数都在这里以具体类型直接调用, 编译期确定, 可被内联
+//消息是热路径: setHandler把bufferevent的读回调换成本类型的read_cb, 读到数据后直接调用H::onMessage
+//连接建立/关闭/心跳每个连接只发生有限次, 以及流水线最后一级交出的消息, 经dispatch转发
+template <typename H>
+struct HandlerDispatch {
+    static void read_cb(struct bufferevent * /*bev*/, void *ctx) {
+        TcpConnection *conn = static_cast<TcpConnection *>(ctx);
+        struct evbuffer *input = conn->beginRead();
+        if (!input) {
+            return;
+        }
+        if (conn->pipeline_) {
+            conn->onMessage(input);
+            return;
+        }
+        static_cast<H *>(conn->handler_)->onMessage(conn->self_, input);
+    }
+
+    static void dispatch(void *handler, TcpConnection::HandlerEvent event, const TcpConnPtr& conn, struct evbuffer *input) {
+        H *h = static_cast<H *>(handler);
+        if (event == TcpConnection::kHandlerMessage) {
+            h->onMessage(conn, input);
+        } else if (event == TcpConnection::kHandlerConnection) {
+            h->onConnection(conn);
+        } else if (event == TcpConnection::kHandlerHeartBeat) {
+            h->onHeartBeat(conn);
+        } else {
+            h->onClose(conn);
+        }
+    }
+
+    //TcpServer/TcpClient保存它, 在新连接上恢复处理对象的具体类型
+    static void install(TcpConnection *conn, void *handler) {
+        conn->setHandler(static_cast<H *>(handler));
+    }
+};
+
+typedef void (*HandlerInstaller)(TcpConnection *conn, void *handler);
+
+template <typename H>
+void TcpConnection::setHandler(H *handler) {
+    handler_ = handler;
+    dispatch_ = &HandlerDispatch<H>::dispatch;
+    if (bev_) {
+        bufferevent_setcb(bev_, &HandlerDispatch<H>::read_cb, write_cb, event_cb, static_cast<void *>(this));
+    }
+}
+
+//处理类的基类, 提供空的默认实现, 派生类只需定义关心的回调(同名隐藏, 不是虚函数)
+//class EchoHandler : public TcpHandler {
+//  public:
+//    void onMessage(const TcpConnPtr& conn, struct evbuffer *input);
+//};
+//server.setHandler(&echoHandler);
+class TcpHandler {
+  public:
+    void onConnection(const TcpConnPtr&) {}
+    void onMessage(const TcpConnPtr&, struct evbuffer *) {}
+    void onHeartBeat(const TcpConnPtr&) {}
+    void onClose(const TcpConnPtr&) {}
+};
+
+#endif // TCPHANDLER_H
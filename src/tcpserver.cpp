@@ -4,44 +4,151 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 
 #include <future>
 
 #include "logging.h"
 #include "util.h"
-#include "eventwatcher.h"
+
+static int openIdleFd() {
+    return ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+//上次进程退出遗留的socket文件会导致bind失败; 先试着连接, 只有无人监听(ECONNREFUSED)时才删除
+//仍有服务在监听时保留文件, 让bind失败, 不抢占正在运行的实例
+//非阻塞连接, 对方accept慢(EAGAIN)或未立即完成时同样视为在用, 不会卡住listen
+static void removeStaleSocket(const struct sockaddr_storage& addr) {
+    const struct sockaddr_un *addr_un = (const struct sockaddr_un *)&addr;
+    if (addr_un->sun_path[0] == '\0') {
+        return;
+    }
+    struct stat st;
+    if (::stat(addr_un->sun_path, &st) != 0 || !S_ISSOCK(st.st_mode)) {
+        return;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        return;
+    }
+    if (::connect(fd, (const struct sockaddr *)&addr, util::sockaddr_len(addr)) != 0 && errno == ECONNREFUSED) {
+        log_info("remove stale unix socket %s", addr_un->sun_path);
+        ::unlink(addr_un->sun_path);
+    }
+    ::close(fd);
+}
+
+TcpServer::Worker::~Worker() {
+    //stop已关闭所有连接并在loop退出后执行完关闭任务, 还在表里的连接不会再释放自引用
+    assert(sessions_.empty());
+    if (idleFd >= 0) {
+        ::close(idleFd);
+    }
+}
 
 TcpServer::TcpServer(struct event_base *base)
     :base_(base),
-     tid_(std::this_thread::get_id()),
-     notified_(false),
-     pending_functor_count_(0),
+     listener_(NULL),
+     loop_(new EventLoop(base)),
+     threadNum_(0),
+     loadBalance_(kRoundRobin),
+     reusePort_(false),
+     maxConnections_(0),
+     connNum_(0),
+     acceptPaused_(false),
+     fdExhausted_(false),
+     idleFd_(-1),
+     idleFdLost_(false),
+     nextWorker_(0),
+     handlerInstaller_(NULL),
+     handler_(NULL),
      isStoped_(false),
      sendHeartBeat_(false),
-     heartBeatInterval_(0) {
-    initWatcher();
+     heartBeatInterval_(0),
+     idleTimeout_(0),
+     writeLowMark_(0),
+     writeHighMark_(0),
+     pauseReadingOnHighWaterMark_(false) {
 }
 
 TcpServer::~TcpServer() {
     stop();
-    sessionMap_.clear();
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        if (w->listener && w->loop != loop_.get()) {
+            w->loop->runInLoop([w]() {
+                evconnlistener_free(w->listener);
+                w->listener = NULL;
+            });
+        }
+    }
+    if (pool_) {
+        pool_->stop();
+        //loop退出时可能还有未执行的关闭和释放任务, 在释放worker之前执行完
+        for (int i = 0; i < pool_->size(); ++i) {
+            pool_->getLoop(i)->drainPendingFunctors();
+        }
+    }
+    workers_.clear();
+    pool_.reset();
+    if (listener_) {
+        evconnlistener_free(listener_);
+        listener_ = NULL;
+    }
+    if (idleFd_ >= 0) {
+        ::close(idleFd_);
+        idleFd_ = -1;
+    }
+    //stop只暂停accept, 之后还可能reStart, 监听关闭时才删除绑定的socket文件
+    if (!unixPath_.empty()) {
+        ::unlink(unixPath_.c_str());
+    }
 }
 
 int TcpServer::listen(const char *ip, int port) {
-    struct sockaddr_in sin;
-    memset(&sin, 0, sizeof(struct sockaddr_in));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = inet_addr(ip);
-    sin.sin_port = htons(port);
+    startWorkers();
+
+    struct sockaddr_storage addr;
+    if (!util::parse_sockaddr(ip, port, &addr)) {
+        log_err("tcp server listen %s:%d error, invalid address", ip, port);
+        return -1;
+    }
+    bool isUnix = addr.ss_family == AF_UNIX;
+    if (isUnix) {
+        removeStaleSocket(addr);
+    }
+
+    if (reusePort_ && pool_ && !isUnix) {
+        if (listenInWorkers(addr) == 0) {
+            log_info("tcp server listen %s:%d with SO_REUSEPORT, worker num:%d", ip, port, (int)workers_.size());
+            return 0;
+        } else {
+            log_err("tcp server listen %s:%d with SO_REUSEPORT error", ip, port);
+            return -1;
+        }
+    }
+
+    unsigned flags = LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE;
+    if (reusePort_ && !isUnix) {
+        flags |= LEV_OPT_REUSEABLE_PORT;
+    }
     listener_ = evconnlistener_new_bind(base_, listener_cb, static_cast<void *>(this),
-                                        LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE, -1,
-                                        (struct sockaddr *)&sin, sizeof(struct sockaddr_in));
+                                        flags, -1,
+                                        (struct sockaddr *)&addr, util::sockaddr_len(addr));
 
     if (listener_) {
         evconnlistener_set_error_cb(listener_, error_cb);
-        log_info("tcp server listen %s:%d", ip, port);
+        idleFd_ = openIdleFd();
+        const struct sockaddr_un *addr_un = (const struct sockaddr_un *)&addr;
+        if (isUnix && addr_un->sun_path[0] != '\0') {
+            unixPath_ = addr_un->sun_path;
+        }
+        log_info("tcp server listen %s:%d, worker num:%d", ip, port, (int)workers_.size());
         return 0;
     } else {
         log_err("tcp server listen %s:%d error", ip, port);
@@ -50,16 +157,122 @@ int TcpServer::listen(const char *ip, int port) {
 }
 
 void TcpServer::stop() {
-    for(auto& connPtr : sessionMap_) {
-        connPtr.second->close();
+    isStoped_ = true;
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        w->loop->runInLoop([w]() {
+            //close会触发RemoveConnection修改sessions_, 先拷贝一份再关闭
+            std::vector<TcpConnPtr> conns;
+            conns.reserve(w->sessions_.size());
+            w->sessions_.forEach([&conns](const TcpConnPtr& conn) {
+                conns.push_back(conn);
+            });
+            for (auto& conn : conns) {
+                conn->close();
+            }
+            if (w->listener) {
+                evconnlistener_disable(w->listener);
+            }
+        });
+    }
+    if (listener_) {
+        evconnlistener_disable(listener_);
     }
-    evconnlistener_disable(listener_);
+}
+
+void TcpServer::drain(int timeoutSeconds, const DrainCallback& cb) {
     isStoped_ = true;
+    if (listener_) {
+        loop_->runInLoop([this]() {
+            evconnlistener_disable(listener_);
+        });
+    }
+    if (workers_.empty()) {
+        if (cb) {
+            cb(0, 0);
+        }
+        return;
+    }
+
+    std::shared_ptr<DrainState> state(new DrainState());
+    state->pendingWorkers = static_cast<int>(workers_.size());
+    state->clean = 0;
+    state->forced = 0;
+    state->cb = cb;
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        w->loop->runInLoop([this, w, state, timeoutSeconds]() {
+            drainInLoop(w, state, timeoutSeconds);
+        });
+    }
+}
+
+void TcpServer::drainInLoop(Worker *worker, const std::shared_ptr<DrainState>& state, int timeoutSeconds) {
+    if (worker->listener) {
+        evconnlistener_disable(worker->listener);
+    }
+    worker->drainState = state;
+    worker->drainClean = 0;
+    worker->drainForced = 0;
+    worker->drainForcing = false;
+    if (worker->sessions_.empty()) {
+        finishDrain(worker);
+        return;
+    }
+
+    //shutdown不会同步关闭连接, 可以直接遍历
+    worker->sessions_.forEach([](const TcpConnPtr& conn) {
+        conn->shutdown();
+    });
+    worker->drainTimer.reset(new Timer(worker->loop->getBase(), timeoutSeconds, [this, worker]() {
+        forceDrain(worker);
+    }, true));
+}
+
+void TcpServer::forceDrain(Worker *worker) {
+    if (!worker->drainState) {
+        return;
+    }
+    std::vector<TcpConnPtr> conns;
+    conns.reserve(worker->sessions_.size());
+    worker->sessions_.forEach([&conns](const TcpConnPtr& conn) {
+        conns.push_back(conn);
+    });
+    log_warn("drain timeout, force close %d connections", (int)conns.size());
+    worker->drainForced = static_cast<int>(conns.size());
+    worker->drainForcing = true;
+    for (auto& conn : conns) {
+        conn->close();
+    }
+    worker->drainForcing = false;
+    finishDrain(worker);
+}
+
+void TcpServer::finishDrain(Worker *worker) {
+    std::shared_ptr<DrainState> state;
+    state.swap(worker->drainState);
+    //定时器可能正在执行本函数的调用者, 不在这里释放, 留到下次drain或worker析构
+    state->clean += worker->drainClean;
+    state->forced += worker->drainForced;
+    if (--state->pendingWorkers == 0) {
+        log_info("tcp server drained, clean:%d forced:%d", state->clean.load(), state->forced.load());
+        if (state->cb) {
+            state->cb(state->clean.load(), state->forced.load());
+        }
+    }
 }
 
 void TcpServer::reStart() {
     isStoped_ = false;
-    evconnlistener_enable(listener_);
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        w->loop->runInLoop([this, w]() {
+            applyAcceptState(w->listener);
+        });
+    }
+    loop_->runInLoop([this]() {
+        applyAcceptState(listener_);
+    });
 }
 
 bool TcpServer::isStoped() {
@@ -73,37 +286,50 @@ void TcpServer::listener_cb(struct evconnlistener *listener, evutil_socket_t fd,
     self->newConnection(fd);
 }
 
-void TcpServer::initWatcher() {
-    watcher_.reset(new PipeEventWatcher(base_, std::bind(&TcpServer::doPendingFunctors, this)));
-    int rc = watcher_->Init();
-    assert(rc);
-    rc = rc && watcher_->AsyncWait();
-    assert(rc);
-    if (!rc) {
-        log_err("PipeEventWatcher init failed");
-    }
+void TcpServer::worker_listener_cb(struct evconnlistener *listener, evutil_socket_t fd,
+                                   struct sockaddr *sa, int socklen, void *ud) {
+    Worker *worker = static_cast<Worker *>(ud);
+    TcpServer *self = worker->server;
+
+    //已在所属工作loop线程内, 无需再转交
+    ++worker->connCount;
+    ++self->connNum_;
+    self->updateAcceptState();
+    self->newConnectionInLoop(worker, fd);
 }
 
-void TcpServer::doPendingFunctors() {
-    std::vector<Functor> functors;
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        notified_.store(false);
-        pending_functors_.swap(functors);
-    }
+void TcpServer::runInLoop(const Functor& functor) {
+    loop_->runInLoop(functor);
+}
 
-    for (size_t i = 0; i < functors.size(); ++i) {
-        functors[i]();
-        --pending_functor_count_;
+void TcpServer::broadcast(const SharedSlice& payload, const ConnectionFilter& filter) {
+    if (payload.empty()) {
+        return;
+    }
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        w->loop->runInLoop([w, payload, filter]() {
+            w->sessions_.forEach([&payload, &filter](const TcpConnPtr& conn) {
+                if (!filter || filter(conn)) {
+                    conn->sendSliceInLoop(payload);
+                }
+            });
+        });
     }
 }
 
-void TcpServer::runInLoop(const Functor& functor) {
-    if (IsInLoopThread()) {
-        functor();
-    } else {
-        queueInLoop(functor);
+void TcpServer::broadcast(const unsigned char *buffer, int size, const ConnectionFilter& filter) {
+    broadcast(SharedSlice(buffer, size), filter);
+}
+
+int TcpServer::pendingFunctorCount() const {
+    int count = loop_->pendingFunctorCount();
+    if (pool_) {
+        for (int i = 0; i < pool_->size(); ++i) {
+            count += pool_->getLoop(i)->pendingFunctorCount();
+        }
     }
+    return count;
 }
 
 void TcpServer::setHeartBeat(bool isSendHeartBeat, int interval) {
@@ -111,52 +337,356 @@ void TcpServer::setHeartBeat(bool isSendHeartBeat, int interval) {
     heartBeatInterval_ = interval;
 }
 
-void TcpServer::queueInLoop(const Functor& cb) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        pending_functors_.emplace_back(cb);
+//总速率按loop数平分, 0表示不限仍为0
+static size_t splitRate(size_t rate, size_t n) {
+    if (rate == 0) {
+        return 0;
+    }
+    return rate / n > 0 ? rate / n : 1;
+}
+
+void TcpServer::setConnectionRateLimit(size_t readRate, size_t writeRate, size_t readBurst, size_t writeBurst) {
+    if (readRate == 0 && writeRate == 0) {
+        connRateLimit_.reset();
+        return;
+    }
+    connRateLimit_ = std::make_shared<RateLimit>(readRate, writeRate, readBurst, writeBurst);
+}
+
+void TcpServer::addRateLimitGroup(const std::string& name, size_t readRate, size_t writeRate,
+                                  size_t readBurst, size_t writeBurst) {
+    if (!workers_.empty()) {
+        log_err("rate limit group %s must be added before listen", name.c_str());
+        return;
     }
-    ++pending_functor_count_;
-    if (!notified_.load()) {
-        watcher_->Notify();
-        notified_.store(true);
+    RateGroupCfg cfg = { readRate, writeRate, readBurst, writeBurst };
+    rateGroupCfgs_[name] = cfg;
+}
+
+bool TcpServer::joinRateLimitGroup(const TcpConnPtr& conn, const std::string& name) {
+    for (auto& worker : workers_) {
+        if (worker->loop != conn->getLoop()) {
+            continue;
+        }
+        auto it = worker->rateGroups.find(name);
+        if (it == worker->rateGroups.end()) {
+            log_warn("rate limit group %s not found", name.c_str());
+            return false;
+        }
+        conn->setRateLimitGroup(it->second.get());
+        return true;
+    }
+    return false;
+}
+
+RateLimitStats TcpServer::getRateLimitStats(const std::string& name) const {
+    RateLimitStats total = { 0, 0 };
+    for (auto& worker : workers_) {
+        auto it = worker->rateGroups.find(name);
+        if (it != worker->rateGroups.end()) {
+            RateLimitStats stats = it->second->getStats();
+            total.readThrottled += stats.readThrottled;
+            total.writeThrottledBytes += stats.writeThrottledBytes;
+        }
+    }
+    return total;
+}
+
+void TcpServer::startWorkers() {
+    if (!workers_.empty()) {
+        return;
+    }
+
+    if (threadNum_ > 0) {
+        pool_.reset(new EventLoopThreadPool(threadNum_));
+        pool_->start();
+        for (int i = 0; i < pool_->size(); ++i) {
+            workers_.emplace_back(new Worker(this, pool_->getLoop(i), i));
+        }
+    } else {
+        workers_.emplace_back(new Worker(this, loop_.get(), 0));
+    }
+
+    //时间轮的定时器,连接对象池和限速组必须在所属loop线程内创建
+    //等全部创建完再返回, 之后rateGroups不再修改, getRateLimitStats可以在任意线程读
+    size_t n = workers_.size();
+    std::vector<std::future<void>> inited;
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        std::shared_ptr<std::promise<void>> done(new std::promise<void>());
+        //主loop可能还未运行, 不在它的线程内时不能等待, 此时没有其他工作线程会读它
+        if (w->loop != loop_.get() || loop_->IsInLoopThread()) {
+            inited.push_back(done->get_future());
+        }
+        w->loop->runInLoop([this, w, n, done]() {
+            w->wheel.reset(new TimingWheel(w->loop->getBase()));
+            w->connPool = std::make_shared<BlockPool>();
+            for (auto& kv : rateGroupCfgs_) {
+                const RateGroupCfg& cfg = kv.second;
+                RateLimitPtr limit = std::make_shared<RateLimit>(
+                    splitRate(cfg.readRate, n), splitRate(cfg.writeRate, n),
+                    splitRate(cfg.readBurst, n), splitRate(cfg.writeBurst, n));
+                w->rateGroups[kv.first].reset(new RateLimitGroup(w->loop->getBase(), limit, kv.first));
+            }
+            done->set_value();
+        });
+    }
+    for (auto& f : inited) {
+        f.get();
     }
 }
 
-void TcpServer::addConnection(std::string &name, const TcpConnPtr &conn) {
-    sessionMap_.emplace(name, conn);
+int TcpServer::listenInWorkers(const struct sockaddr_storage& addr) {
+    std::vector<std::future<bool>> results;
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        std::shared_ptr<std::promise<bool>> done(new std::promise<bool>());
+        results.push_back(done->get_future());
+        w->loop->runInLoop([w, addr, done]() {
+            w->listener = evconnlistener_new_bind(w->loop->getBase(), worker_listener_cb, static_cast<void *>(w),
+                                                  LEV_OPT_REUSEABLE | LEV_OPT_REUSEABLE_PORT | LEV_OPT_CLOSE_ON_FREE, -1,
+                                                  (struct sockaddr *)&addr, util::sockaddr_len(addr));
+            if (w->listener) {
+                evconnlistener_set_error_cb(w->listener, worker_error_cb);
+                w->idleFd = openIdleFd();
+            }
+            done->set_value(w->listener != NULL);
+        });
+    }
+
+    int rc = 0;
+    for (auto& result : results) {
+        if (!result.get()) {
+            rc = -1;
+        }
+    }
+    if (rc == 0) {
+        return 0;
+    }
+
+    //部分worker绑定成功时要全部撤掉, 否则退回单个监听后它们仍会分走新连接
+    std::vector<std::future<void>> closed;
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        std::shared_ptr<std::promise<void>> done(new std::promise<void>());
+        closed.push_back(done->get_future());
+        w->loop->runInLoop([w, done]() {
+            if (w->listener) {
+                evconnlistener_free(w->listener);
+                w->listener = NULL;
+            }
+            if (w->idleFd >= 0) {
+                ::close(w->idleFd);
+                w->idleFd = -1;
+            }
+            done->set_value();
+        });
+    }
+    for (auto& c : closed) {
+        c.get();
+    }
+    return rc;
 }
 
-void TcpServer::RemoveConnection(const TcpConnPtr &conn) {
+TcpServer::Worker *TcpServer::getNextWorker() {
+    assert(!workers_.empty());
+    if (workers_.size() == 1) {
+        return workers_[0].get();
+    }
+
+    if (loadBalance_ == kLeastConnections) {
+        Worker *least = workers_[0].get();
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            if (workers_[i]->connCount.load() < least->connCount.load()) {
+                least = workers_[i].get();
+            }
+        }
+        return least;
+    }
+
+    Worker *worker = workers_[nextWorker_].get();
+    nextWorker_ = (nextWorker_ + 1) % workers_.size();
+    return worker;
+}
+
+void TcpServer::addConnection(Worker *worker, const TcpConnPtr &conn) {
+    conn->setId(worker->sessions_.insert(conn));
+}
+
+void TcpServer::RemoveConnection(Worker *worker, const TcpConnPtr &conn) {
     auto f = [ = ]() {
-        this->sessionMap_.erase(conn->getName());
+        if (worker->sessions_.remove(conn->getId())) {
+            --worker->connCount;
+            onConnectionClosed();
+            if (worker->drainState) {
+                if (!worker->drainForcing) {
+                    ++worker->drainClean;
+                }
+                if (worker->sessions_.empty() && !worker->drainForcing) {
+                    finishDrain(worker);
+                }
+            }
+        }
     };
-    runInLoop(f);
+    worker->loop->runInLoop(f);
 }
 
 void TcpServer::newConnection(evutil_socket_t fd) {
-    std::string conn_name = "server" + util::get_peer_ip(fd) + "#" + std::to_string(next_conn_id_++);
-    TcpConnPtr conn(new TcpConnection(base_, fd, conn_name));
+    Worker *worker = getNextWorker();
+    ++worker->connCount;
+    ++connNum_;
+    updateAcceptState();
+    worker->loop->runInLoop([this, worker, fd]() {
+        newConnectionInLoop(worker, fd);
+    });
+}
+
+void TcpServer::newConnectionInLoop(Worker *worker, evutil_socket_t fd) {
+    TcpConnPtr conn = TcpConnection::create(worker->loop, fd, std::string(), worker->connPool);
 
     conn->setMessageCallback(message_cb_);
+    conn->setPipeline(pipeline_);
     conn->setConnectionCallback(connection_cb_);
-    conn->setCloseCallback(std::bind(&TcpServer::RemoveConnection, this, std::placeholders::_1));
-    conn->setHeartBeatOpt(sendHeartBeat_, heartBeatInterval_);
-    conn->setHBCallback([this](const TcpConnPtr& conn) {
-        if(HBCallback_) {
-            HBCallback_(conn);
-        }
-    });
+    conn->setCloseCallback(std::bind(&TcpServer::RemoveConnection, this, worker, std::placeholders::_1));
+    conn->setTimingWheelOpt(sendHeartBeat_, heartBeatInterval_, idleTimeout_);
+    conn->setHBCallback(HBCallback_);
+    if (handlerInstaller_) {
+        handlerInstaller_(conn.get(), handler_);
+    }
+    if (writeLowMark_ > 0 || writeHighMark_ > 0) {
+        conn->setWriteWaterMark(writeLowMark_, writeHighMark_);
+    }
+    conn->setHighWaterMarkCallback(highWaterMark_cb_);
+    conn->setWriteCompleteCallback(writeComplete_cb_);
+    conn->setPauseReadingOnHighWaterMark(pauseReadingOnHighWaterMark_);
+    if (connRateLimit_) {
+        conn->setRateLimit(connRateLimit_);
+    }
 
+    addConnection(worker, conn);
+    worker->wheel->add(conn);
     conn->onConnectionEstablished();
-    addConnection(conn_name, conn);
+    //drain开始前已accept的连接, 同样等它写完后关闭
+    if (worker->drainState) {
+        conn->shutdown();
+    }
 }
 
-void TcpServer::error_cb(struct evconnlistener *listener, void *ctx) {
-    struct event_base *base = evconnlistener_get_base(listener);
+void TcpServer::onConnectionClosed() {
+    --connNum_;
+    //释放了fd, 之前因fd耗尽暂停的accept可以恢复
+    fdExhausted_ = false;
+    if (idleFdLost_.exchange(false)) {
+        reopenIdleFds();
+    }
+    updateAcceptState();
+}
+
+//在各监听器所属的loop里补回丢失的预留fd, 还是拿不到时留给下一次连接关闭
+void TcpServer::reopenIdleFds() {
+    for (auto& worker : workers_) {
+        Worker *w = worker.get();
+        if (w->listener) {
+            w->loop->runInLoop([this, w]() {
+                if (w->listener && w->idleFd < 0) {
+                    w->idleFd = openIdleFd();
+                    if (w->idleFd < 0) {
+                        idleFdLost_ = true;
+                    }
+                }
+            });
+        }
+    }
+    if (listener_) {
+        loop_->runInLoop([this]() {
+            if (listener_ && idleFd_ < 0) {
+                idleFd_ = openIdleFd();
+                if (idleFd_ < 0) {
+                    idleFdLost_ = true;
+                }
+            }
+        });
+    }
+}
+
+void TcpServer::updateAcceptState() {
+    for (;;) {
+        bool full = (maxConnections_ > 0 && connNum_.load() >= maxConnections_) || fdExhausted_.load();
+        bool paused = acceptPaused_.load();
+        if (full == paused) {
+            return;
+        }
+        //CAS成功后再检查一次, 防止与其他线程的计数变化交错后停在错误状态
+        if (acceptPaused_.compare_exchange_strong(paused, full)) {
+            if (full) {
+                log_warn("tcp server pause accepting, connections:%d", connNum_.load());
+            } else {
+                log_info("tcp server resume accepting, connections:%d", connNum_.load());
+            }
+            for (auto& worker : workers_) {
+                Worker *w = worker.get();
+                if (w->listener) {
+                    w->loop->runInLoop([this, w]() {
+                        applyAcceptState(w->listener);
+                    });
+                }
+            }
+            if (listener_) {
+                loop_->runInLoop([this]() {
+                    applyAcceptState(listener_);
+                });
+            }
+        }
+    }
+}
+
+void TcpServer::applyAcceptState(struct evconnlistener *listener) {
+    //在listener所属loop内执行, 按执行时的最新状态决定, 不依赖投递顺序
+    if (!listener) {
+        return;
+    }
+    if (isStoped_ || acceptPaused_) {
+        evconnlistener_disable(listener);
+    } else {
+        evconnlistener_enable(listener);
+    }
+}
+
+void TcpServer::handleAcceptError(struct evconnlistener *listener, int *idleFd) {
     int err = EVUTIL_SOCKET_ERROR();
+    if (err == EMFILE || err == ENFILE) {
+        if (*idleFd >= 0) {
+            //让出预留fd, accept一个排队的连接后立即关闭, 避免监听fd一直可读导致空转
+            ::close(*idleFd);
+            evutil_socket_t fd = ::accept(evconnlistener_get_fd(listener), NULL, NULL);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            *idleFd = openIdleFd();
+            log_warn("listener got error %d (%s), shed one pending connection", err, evutil_socket_error_to_string(err));
+            if (*idleFd >= 0) {
+                return;
+            }
+        }
+        //连预留fd都拿不回来, 暂停accept直到有连接关闭, 那时再补预留fd
+        idleFdLost_ = true;
+        log_err("listener got error %d (%s), pause accepting until a connection closes", err, evutil_socket_error_to_string(err));
+        fdExhausted_ = true;
+        updateAcceptState();
+        return;
+    }
+
+    struct event_base *base = evconnlistener_get_base(listener);
     log_err("Got an error %d (%s) on the listener, Shutting down.", err, evutil_socket_error_to_string(err));
     event_base_loopexit(base, NULL);
 }
 
+void TcpServer::error_cb(struct evconnlistener *listener, void *ctx) {
+    TcpServer *self = static_cast<TcpServer *>(ctx);
+    self->handleAcceptError(listener, &self->idleFd_);
+}
 
+void TcpServer::worker_error_cb(struct evconnlistener *listener, void *ctx) {
+    Worker *worker = static_cast<Worker *>(ctx);
+    worker->server->handleAcceptError(listener, &worker->idleFd);
+}
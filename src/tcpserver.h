@@ -12,22 +12,67 @@
 
 #include "libevent_headers.h"
 #include "tcpconnection.h"
+#include "eventloop.h"
+#include "connectiontable.h"
+#include "timingwheel.h"
+#include "tcphandler.h"
+#include "ratelimit.h"
+#include "timer.h"
 
-typedef std::function<void()> Functor;
-
-class PipeEventWatcher;
+typedef std::function<bool(const TcpConnPtr&)> ConnectionFilter;
+//clean为期限内由对端或正常流程关闭的连接数, forced为到期后被强制关闭的连接数
+typedef std::function<void(int clean, int forced)> DrainCallback;
 
 class TcpServer {
   public:
+    //新连接分发到工作线程的策略
+    enum LoadBalance { kRoundRobin, kLeastConnections };
+
     TcpServer(struct event_base *base);
     ~TcpServer();
+    //ip为IPv4/IPv6地址, 或"unix:/path"、"unix:@name"(抽象命名空间), unix socket忽略port
+    //监听unix路径前会删除无人监听的遗留socket文件, 析构时删除自己创建的文件; unix socket不支持SO_REUSEPORT, 退回单个监听
     int listen(const char* ip, int port);
     void stop();
+    //优雅停止: 停止accept, 每个连接写完输出缓冲区后shutdown(SHUT_WR)等待对端关闭,
+    //timeoutSeconds秒后仍未关闭的连接强制关闭; 全部结束后在最后完成的工作loop线程内回调
+    void drain(int timeoutSeconds, const DrainCallback& cb = DrainCallback());
     void reStart();
     bool isStoped();
 
     void runInLoop(const Functor &functor);
 
+    //数据只序列化一次, 所有连接共享同一份内存; 多loop时各工作线程并行发送自己的连接
+    //filter在各工作loop线程内调用, 为空时发给所有连接
+    void broadcast(const SharedSlice& payload, const ConnectionFilter& filter = ConnectionFilter());
+    void broadcast(const unsigned char *buffer, int size, const ConnectionFilter& filter = ConnectionFilter());
+
+    //主loop及所有工作loop中待执行的跨线程任务总数
+    int pendingFunctorCount() const;
+
+    //需在listen之前调用, 0表示所有连接都运行在构造时传入的event_base上
+    void setThreadNum(int threadNum) {
+        threadNum_ = threadNum;
+    }
+
+    void setLoadBalance(LoadBalance policy) {
+        loadBalance_ = policy;
+    }
+
+    //开启后每个工作loop各自以SO_REUSEPORT监听同一端口, 由内核分发新连接, 需在listen之前调用
+    void setReusePort(bool reusePort) {
+        reusePort_ = reusePort;
+    }
+
+    //连接数达到上限时暂停accept, 有连接关闭后自动恢复, 0表示不限制
+    void setMaxConnections(int maxConnections) {
+        maxConnections_ = maxConnections;
+    }
+
+    int getConnectionNum() const {
+        return connNum_.load();
+    }
+
     void setConnectionCallback(const ConnectionCallBack& cb) {
         connection_cb_ = cb;
     }
@@ -38,49 +83,161 @@ class TcpServer {
 
     void setHeartBeat(bool isSendHeartBeat, int interval);
 
+    //连接超过seconds秒没有收到数据则主动断开, 0表示不检查
+    void setIdleTimeout(int seconds) {
+        idleTimeout_ = seconds;
+    }
+
     void setHBCallback(HeartBeatCallBack cb) {
         HBCallback_ = cb;
     }
 
+    //写背压, 作用于之后建立的连接, 见TcpConnection::setWriteWaterMark/setHighWaterMarkCallback
+    void setWriteWaterMark(int low, int high) {
+        writeLowMark_ = low;
+        writeHighMark_ = high;
+    }
+    void setHighWaterMarkCallback(const HighWaterMarkCallBack& cb) {
+        highWaterMark_cb_ = cb;
+    }
+    void setWriteCompleteCallback(const WriteCompleteCallBack& cb) {
+        writeComplete_cb_ = cb;
+    }
+    void setPauseReadingOnHighWaterMark(bool pause) {
+        pauseReadingOnHighWaterMark_ = pause;
+    }
+
+    //每个连接各自的令牌桶限速(字节/秒, 0表示不限), 作用于之后建立的连接
+    void setConnectionRateLimit(size_t readRate, size_t writeRate, size_t readBurst = 0, size_t writeBurst = 0);
+    //命名限速组, 组内连接共享总速率; libevent的限速组不能跨event_base, 总速率按工作loop数平分
+    //须在listen之前添加
+    void addRateLimitGroup(const std::string& name, size_t readRate, size_t writeRate,
+                           size_t readBurst = 0, size_t writeBurst = 0);
+    //把连接加入命名组, 须在连接所属loop线程内调用(如连接回调中)
+    bool joinRateLimitGroup(const TcpConnPtr& conn, const std::string& name);
+    //各工作loop上同名组的统计之和, 可在任意线程调用; listen返回时各组已创建完, 之后不再修改
+    RateLimitStats getRateLimitStats(const std::string& name) const;
+
+    //以静态分发的处理对象代替std::function回调, handler须比server活得久, 须在listen之前设置
+    //H需提供onConnection/onMessage/onHeartBeat/onClose, 可继承TcpHandler获得空实现
+    template <typename H>
+    void setHandler(H *handler) {
+        handlerInstaller_ = &HandlerDispatch<H>::install;
+        handler_ = handler;
+    }
+
+    //所有新连接共享同一条流水线, 须在listen之前设置
+    void setPipeline(const PipelinePtr& pipeline) {
+        pipeline_ = pipeline;
+    }
+
   private:
+    //一次drain的汇总, 由各工作loop共享
+    struct DrainState {
+        std::atomic<int> pendingWorkers;
+        std::atomic<int> clean;
+        std::atomic<int> forced;
+        DrainCallback cb;
+    };
+
+    //每个工作loop独占自己的连接表, 只在该loop线程内访问
+    struct Worker {
+        Worker(TcpServer *s, EventLoop *l, uint32_t index)
+            : server(s), loop(l), listener(NULL), idleFd(-1), sessions_(index), connCount(0),
+              drainClean(0), drainForced(0), drainForcing(false) {}
+        ~Worker();
+
+        TcpServer *server;
+        EventLoop *loop;
+        struct evconnlistener *listener;
+        int idleFd;
+        ConnectionTable sessions_;
+        std::unique_ptr<TimingWheel> wheel;
+        BlockPoolPtr connPool;
+        std::unordered_map<std::string, std::unique_ptr<RateLimitGroup>> rateGroups;
+        std::atomic<int> connCount;
+
+        //以下只在所属loop线程内访问
+        std::shared_ptr<DrainState> drainState;
+        std::unique_ptr<Timer> drainTimer;
+        int drainClean;
+        int drainForced;
+        bool drainForcing;
+    };
+
     static void error_cb(struct evconnlistener *listener, void *ctx);
+    static void worker_error_cb(struct evconnlistener *listener, void *ctx);
     static void listener_cb(struct evconnlistener *listener, evutil_socket_t fd,
                             struct sockaddr *sa, int socklen, void *ud);
+    static void worker_listener_cb(struct evconnlistener *listener, evutil_socket_t fd,
+                                   struct sockaddr *sa, int socklen, void *ud);
 
-    void initWatcher();
-    void doPendingFunctors();
+    void startWorkers();
+    int listenInWorkers(const struct sockaddr_storage& addr);
+    Worker *getNextWorker();
 
-    bool IsInLoopThread() const {
-        return tid_ == std::this_thread::get_id();
-    }
-    void queueInLoop(const Functor &cb);
+    void handleAcceptError(struct evconnlistener *listener, int *idleFd);
+    void updateAcceptState();
+    void applyAcceptState(struct evconnlistener *listener);
+    void onConnectionClosed();
+    void reopenIdleFds();
 
-    void addConnection(std::string& name, const TcpConnPtr& conn);
-    void RemoveConnection(const TcpConnPtr& conn);
+    void addConnection(Worker *worker, const TcpConnPtr& conn);
+    void RemoveConnection(Worker *worker, const TcpConnPtr& conn);
 
     void newConnection(evutil_socket_t fd);
+    void newConnectionInLoop(Worker *worker, evutil_socket_t fd);
+    void drainInLoop(Worker *worker, const std::shared_ptr<DrainState>& state, int timeoutSeconds);
+    void forceDrain(Worker *worker);
+    void finishDrain(Worker *worker);
 
     struct event_base *base_;
     struct evconnlistener *listener_;
-
-    uint64_t next_conn_id_;
-    std::unordered_map<std::string, TcpConnPtr>      sessionMap_;
+    std::string unixPath_;      //监听的unix socket文件, 析构时删除
+    std::unique_ptr<EventLoop> loop_;
+
+    int threadNum_;
+    LoadBalance loadBalance_;
+    bool reusePort_;
+    int maxConnections_;
+    std::atomic<int> connNum_;
+    std::atomic<bool> acceptPaused_;
+    std::atomic<bool> fdExhausted_;
+    //预留的空闲fd, EMFILE时释放出来用于accept并立即关闭排队的连接
+    int idleFd_;
+    //有监听器让出预留fd后没能重新拿到, 连接关闭时再补
+    std::atomic<bool> idleFdLost_;
+    std::unique_ptr<EventLoopThreadPool> pool_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    size_t nextWorker_;
 
     ConnectionCallBack connection_cb_;
     MessageCallBack message_cb_;
     HeartBeatCallBack HBCallback_;
+    HighWaterMarkCallBack highWaterMark_cb_;
+    WriteCompleteCallBack writeComplete_cb_;
+    HandlerInstaller handlerInstaller_;
+    void *handler_;
+    PipelinePtr pipeline_;
 
-    std::thread::id tid_;
-    std::mutex mutex_;
-    std::shared_ptr<PipeEventWatcher> watcher_;
-    std::atomic<bool> notified_;
-    std::vector<Functor> pending_functors_;
-    std::atomic<int> pending_functor_count_;
-
-    bool isStoped_;
+    std::atomic<bool> isStoped_;
 
     bool sendHeartBeat_;
     int heartBeatInterval_;
+    int idleTimeout_;
+
+    int writeLowMark_;
+    int writeHighMark_;
+    bool pauseReadingOnHighWaterMark_;
+
+    struct RateGroupCfg {
+        size_t readRate;
+        size_t writeRate;
+        size_t readBurst;
+        size_t writeBurst;
+    };
+    RateLimitPtr connRateLimit_;
+    std::unordered_map<std::string, RateGroupCfg> rateGroupCfgs_;
 };
 
 #endif  // TCPSERVER_H
@@ -4,18 +4,21 @@
 static void timer_cb(int fd, short event, void *arg) {
     TimerCBContext *tc = (TimerCBContext*)arg;
     if (tc) {
+        //一次性定时器触发后不再等待, 回调里可以再次add
+        if (!tc->persist) {
+            tc->pending = false;
+        }
         tc->cb();
     }
 }
 
 Timer::Timer(event_base *base, const timerTask &task) {
-    tc = new TimerCBContext{task};
+    tc = new TimerCBContext{task, false, false};
     timer = evtimer_new(base, timer_cb, tc);
-    pending = false;
 }
 
 Timer::Timer(event_base *base, int second, const timerTask &task, bool temporary) {
-    tc = new TimerCBContext{task};
+    tc = new TimerCBContext{task, !temporary, false};
     if(temporary) {
         timer = evtimer_new(base, timer_cb, tc);
     } else {
@@ -26,7 +29,7 @@ Timer::Timer(event_base *base, int second, const timerTask &task, bool temporary
     tv.tv_sec = second;
     tv.tv_usec = 0;
     evtimer_add(timer, &tv);
-    pending = true;
+    tc->pending = true;
 }
 
 Timer::~Timer() {
@@ -34,7 +37,7 @@ Timer::~Timer() {
 }
 
 void Timer::add(int seconds) {
-    if(!pending) {
+    if(!tc->pending) {
         struct timeval tv;
         tv.tv_sec = seconds;
         tv.tv_usec = 0;
@@ -42,6 +45,22 @@ void Timer::add(int seconds) {
     }
 }
 
+void Timer::addMilliseconds(int milliseconds) {
+    if(!tc->pending) {
+        struct timeval tv;
+        tv.tv_sec = milliseconds / 1000;
+        tv.tv_usec = (milliseconds % 1000) * 1000;
+        evtimer_add(timer, &tv);
+    }
+}
+
+void Timer::stop() {
+    if(timer) {
+        event_del(timer);
+    }
+    tc->pending = false;
+}
+
 void Timer::cancle() {
     if(timer) {
         event_del(timer);
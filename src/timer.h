@@ -9,6 +9,9 @@ typedef std::function<void()> timerTask;
 
 struct TimerCBContext {
     timerTask cb;
+    bool persist;
+    //构造时启动的定时器在等待期间为true, add不会打乱它的周期
+    bool pending;
 };
 
 class Timer {
@@ -18,11 +21,14 @@ class Timer {
     ~Timer();
 
     void add(int seconds);
+    //毫秒精度, 已在等待中的定时器会按新的时间重新计时(构造时启动且尚未触发或停止的除外)
+    void addMilliseconds(int milliseconds);
+    //取消等待但不释放, 之后可以再次add
+    void stop();
     void cancle();
   private:
     struct event *timer;
     TimerCBContext *tc;
-    bool pending;
 };
 
 #endif // PERSISTTIMER_H
@@ -0,0 +1,93 @@
+#include "timingwheel.h"
+
+#include <time.h>
+
+#include "timer.h"
+#include "logging.h"
+
+TimingWheel::TimingWheel(struct event_base *base, int slots)
+    :base_(base),
+     buckets_(slots > 0 ? slots : 1),
+     lastTick_(time(NULL)),
+     size_(0) {
+    timer_.reset(new Timer(base_, 1, std::bind(&TimingWheel::onTick, this)));
+}
+
+TimingWheel::~TimingWheel() {
+}
+
+void TimingWheel::add(const TcpConnPtr& conn) {
+    int64_t deadline = nextDeadline(conn.get());
+    if (deadline <= 0) {
+        return;
+    }
+    insert(conn, deadline);
+    ++size_;
+}
+
+void TimingWheel::insert(const TcpConnPtr& conn, int64_t deadline) {
+    buckets_[deadline % buckets_.size()].push_back(conn);
+}
+
+int64_t TimingWheel::nextDeadline(const TcpConnection *conn) {
+    int64_t deadline = 0;
+    if (conn->sendHeartBeat_ && conn->heartBeatInterval_ > 0) {
+        //连续空闲时每隔一个周期触发一次心跳
+        int64_t last = conn->activeTime_ > conn->heartBeatTime_ ? conn->activeTime_ : conn->heartBeatTime_;
+        deadline = last + conn->heartBeatInterval_;
+    }
+    if (conn->idleTimeout_ > 0) {
+        int64_t idle = conn->activeTime_ + conn->idleTimeout_;
+        if (deadline == 0 || idle < deadline) {
+            deadline = idle;
+        }
+    }
+    return deadline;
+}
+
+void TimingWheel::onTick() {
+    int64_t now = time(NULL);
+    //loop被阻塞时补扫错过的桶, 最多扫一整圈
+    int64_t from = lastTick_ + 1;
+    if (now - from >= static_cast<int64_t>(buckets_.size())) {
+        from = now - buckets_.size() + 1;
+    }
+    for (int64_t tick = from; tick <= now; ++tick) {
+        std::vector<TcpConnWeakPtr> bucket;
+        bucket.swap(buckets_[tick % buckets_.size()]);
+        expire(bucket, now);
+    }
+    if (now > lastTick_) {
+        lastTick_ = now;
+    }
+}
+
+void TimingWheel::expire(std::vector<TcpConnWeakPtr>& bucket, int64_t now) {
+    for (auto& entry : bucket) {
+        TcpConnPtr conn = entry.lock();
+        if (!conn || conn->getBev() == NULL) {
+            --size_;
+            continue;
+        }
+
+        if (conn->idleTimeout_ > 0 && now - conn->activeTime_ >= conn->idleTimeout_) {
+            log_warn("connection:%s idle for %d seconds, kick it", conn->getName().c_str(), (int)(now - conn->activeTime_));
+            --size_;
+            conn->close();
+            continue;
+        }
+
+        int64_t deadline = nextDeadline(conn.get());
+        if (deadline <= now && conn->sendHeartBeat_) {
+            conn->heartBeatTime_ = now;
+            conn->onHeartBeat();
+            if (conn->getBev() == NULL) {
+                --size_;
+                continue;
+            }
+            deadline = nextDeadline(conn.get());
+        }
+        //未到期的连接按最新期限重新挂桶, 超过一圈的期限会被提前扫到并再次挂回
+        insert(conn, deadline > now ? deadline : now + 1);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "libevent_headers.h"
+#include "tcpconnection.h"
+
+class Timer;
+
+//按秒推进的哈希时间轮, 统一管理一个loop上所有连接的心跳和空闲超时, 只在所属loop线程内访问
+//连接收到数据时只更新activeTime(O(1)), 到期桶被扫描时再按最新的activeTime决定触发或重新挂到新的桶上
+class TimingWheel {
+  public:
+    explicit TimingWheel(struct event_base *base, int slots = 64);
+    ~TimingWheel();
+
+    void add(const TcpConnPtr& conn);
+
+    size_t size() const {
+        return size_;
+    }
+
+  private:
+    void onTick();
+    void expire(std::vector<TcpConnWeakPtr>& bucket, int64_t now);
+    void insert(const TcpConnPtr& conn, int64_t deadline);
+
+    static int64_t nextDeadline(const TcpConnection *conn);
+
+    struct event_base *base_;
+    std::unique_ptr<Timer> timer_;
+    std::vector<std::vector<TcpConnWeakPtr>> buckets_;
+    int64_t lastTick_;
+    size_t size_;
+};
+
+#endif // TIMINGWHEEL_H
@@ -4,6 +4,8 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/un.h>
+#include <stddef.h>
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <math.h>
@@ -12,60 +14,94 @@
 
 namespace util {
 
-std::string get_local_ip(int fd) {
-    struct sockaddr addr;
-    struct sockaddr_in* addr_v4;
-    socklen_t addr_len = sizeof(addr);
-
-    memset(&addr, 0, sizeof(addr));
-    if (0 == getsockname(fd, &addr, &addr_len)) {
-        if (addr.sa_family == AF_INET) {
-            addr_v4 = (sockaddr_in*) &addr;
-            return std::string(inet_ntoa(addr_v4->sin_addr));
+static std::string sockaddr_ip(const struct sockaddr_storage& addr) {
+    char buf[INET6_ADDRSTRLEN];
+    if (addr.ss_family == AF_INET) {
+        const struct sockaddr_in *addr_v4 = (const struct sockaddr_in *)&addr;
+        return inet_ntop(AF_INET, &addr_v4->sin_addr, buf, sizeof(buf)) ? buf : "0.0.0.0";
+    } else if (addr.ss_family == AF_INET6) {
+        const struct sockaddr_in6 *addr_v6 = (const struct sockaddr_in6 *)&addr;
+        return inet_ntop(AF_INET6, &addr_v6->sin6_addr, buf, sizeof(buf)) ? buf : "::";
+    } else if (addr.ss_family == AF_UNIX) {
+        //抽象命名空间以'@'表示开头的'\0', 未绑定的socket路径为空
+        const struct sockaddr_un *addr_un = (const struct sockaddr_un *)&addr;
+        if (addr_un->sun_path[0] == '\0') {
+            size_t len = strnlen(addr_un->sun_path + 1, sizeof(addr_un->sun_path) - 1);
+            return len > 0 ? "@" + std::string(addr_un->sun_path + 1, len) : "";
         }
+        return std::string(addr_un->sun_path, strnlen(addr_un->sun_path, sizeof(addr_un->sun_path)));
+    }
+    return "0.0.0.0";
+}
+
+static uint16_t sockaddr_port(const struct sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET) {
+        return ntohs(((const struct sockaddr_in *)&addr)->sin_port);
+    } else if (addr.ss_family == AF_INET6) {
+        return ntohs(((const struct sockaddr_in6 *)&addr)->sin6_port);
+    }
+    return 0;
+}
+
+static bool get_sockaddr(int fd, bool peer, struct sockaddr_storage *addr) {
+    socklen_t addr_len = sizeof(*addr);
+    memset(addr, 0, sizeof(*addr));
+    if (peer) {
+        return 0 == getpeername(fd, (struct sockaddr *)addr, &addr_len);
+    }
+    return 0 == getsockname(fd, (struct sockaddr *)addr, &addr_len);
+}
+
+std::string get_local_ip(int fd) {
+    struct sockaddr_storage addr;
+    if (get_sockaddr(fd, false, &addr)) {
+        return sockaddr_ip(addr);
     }
     return "0.0.0.0";
 }
 
 uint16_t get_local_port(int fd) {
-    struct sockaddr addr;
-    struct sockaddr_in* addr_v4;
-    socklen_t addr_len = sizeof(addr);
-    if (0 == getsockname(fd, &addr, &addr_len)) {
-        if (addr.sa_family == AF_INET) {
-            addr_v4 = (sockaddr_in*) &addr;
-            return ntohs(addr_v4->sin_port);
-        }
+    struct sockaddr_storage addr;
+    if (get_sockaddr(fd, false, &addr)) {
+        return sockaddr_port(addr);
     }
     return 0;
 }
 
 std::string get_peer_ip(int fd) {
-    struct sockaddr addr;
-    struct sockaddr_in* addr_v4;
-    socklen_t addr_len = sizeof(addr);
-    if (0 == getpeername(fd, &addr, &addr_len)) {
-        if (addr.sa_family == AF_INET) {
-            addr_v4 = (sockaddr_in*) &addr;
-            return std::string(inet_ntoa(addr_v4->sin_addr));
-        }
+    struct sockaddr_storage addr;
+    if (get_sockaddr(fd, true, &addr)) {
+        return sockaddr_ip(addr);
     }
     return "0.0.0.0";
 }
 
 uint16_t get_peer_port(int fd) {
-    struct sockaddr addr;
-    struct sockaddr_in* addr_v4;
-    socklen_t addr_len = sizeof(addr);
-    if (0 == getpeername(fd, &addr, &addr_len)) {
-        if (addr.sa_family == AF_INET) {
-            addr_v4 = (sockaddr_in*) &addr;
-            return ntohs(addr_v4->sin_port);
-        }
+    struct sockaddr_storage addr;
+    if (get_sockaddr(fd, true, &addr)) {
+        return sockaddr_port(addr);
     }
     return 0;
 }
 
+std::string get_peer_addr(int fd) {
+    struct sockaddr_storage addr;
+    if (get_sockaddr(fd, true, &addr)) {
+        return sockaddr_to_string(addr);
+    }
+    return "0.0.0.0:0";
+}
+
+std::string sockaddr_to_string(const struct sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET6) {
+        return "[" + sockaddr_ip(addr) + "]:" + std::to_string(sockaddr_port(addr));
+    } else if (addr.ss_family == AF_UNIX) {
+        //客户端一侧的unix socket通常未绑定, 路径为空
+        return "unix:" + sockaddr_ip(addr);
+    }
+    return sockaddr_ip(addr) + ":" + std::to_string(sockaddr_port(addr));
+}
+
 long getCurrentTime() {
     struct timeval tv;
     gettimeofday(&tv,NULL);
@@ -81,6 +117,54 @@ void int2ip( int ip_num, char *ip ) {
     strcpy( ip, (char*)inet_ntoa(in));
 }
 
+bool parse_sockaddr(const std::string& ip, int port, struct sockaddr_storage *addr) {
+    memset(addr, 0, sizeof(*addr));
+    if (ip.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un *addr_un = (struct sockaddr_un *)addr;
+        std::string path = ip.substr(5);
+        if (path.empty() || path.size() >= sizeof(addr_un->sun_path)) {
+            return false;
+        }
+        addr_un->sun_family = AF_UNIX;
+        memcpy(addr_un->sun_path, path.data(), path.size());
+        if (path[0] == '@') {
+            addr_un->sun_path[0] = '\0';
+        }
+        return true;
+    }
+    struct sockaddr_in *addr_v4 = (struct sockaddr_in *)addr;
+    if (inet_pton(AF_INET, ip.c_str(), &addr_v4->sin_addr) == 1) {
+        addr_v4->sin_family = AF_INET;
+        addr_v4->sin_port = htons(port);
+        return true;
+    }
+    //允许带方括号的写法"[::1]"
+    std::string ip6 = ip.size() > 2 && ip[0] == '[' && ip[ip.size() - 1] == ']' ? ip.substr(1, ip.size() - 2) : ip;
+    struct sockaddr_in6 *addr_v6 = (struct sockaddr_in6 *)addr;
+    if (inet_pton(AF_INET6, ip6.c_str(), &addr_v6->sin6_addr) == 1) {
+        addr_v6->sin6_family = AF_INET6;
+        addr_v6->sin6_port = htons(port);
+        return true;
+    }
+    return false;
+}
+
+socklen_t sockaddr_len(const struct sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET) {
+        return sizeof(struct sockaddr_in);
+    } else if (addr.ss_family == AF_INET6) {
+        return sizeof(struct sockaddr_in6);
+    } else if (addr.ss_family == AF_UNIX) {
+        //抽象命名空间的名字不以'\0'结尾, 长度必须精确
+        const struct sockaddr_un *addr_un = (const struct sockaddr_un *)&addr;
+        if (addr_un->sun_path[0] == '\0') {
+            return offsetof(struct sockaddr_un, sun_path) + 1 + strnlen(addr_un->sun_path + 1, sizeof(addr_un->sun_path) - 1);
+        }
+        return sizeof(struct sockaddr_un);
+    }
+    return sizeof(struct sockaddr_storage);
+}
+
 std::string timetodate(const time_t time) {
     struct tm *l=localtime(&time);
     char buf[128];
@@ -191,6 +275,32 @@ std::vector<std::string> split(const std::string &str, std::string sep)
     return ret;
 }
 
+static const uint32_t *crc32cTable() {
+    static uint32_t table[256];
+    static bool inited = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+            }
+            table[i] = crc;
+        }
+        return true;
+    }();
+    (void)inited;
+    return table;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+    const uint32_t *table = crc32cTable();
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    crc = ~crc;
+    while (len--) {
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
 }
 
 
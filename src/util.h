@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <sys/time.h>
+#include <sys/socket.h>
 #include <time.h>
 
 #include <string>
@@ -12,14 +13,21 @@
 
 namespace util {
 
-//ip处理函数
+//ip处理函数, 支持IPv4/IPv6/unix socket, unix socket的ip为路径(抽象命名空间以'@'开头), 端口为0
 std::string get_local_ip(int fd);
 std::string get_local_ip();
 uint16_t get_local_port(int fd);
 std::string get_peer_ip(int fd);
 uint16_t get_peer_port(int fd);
+//"1.2.3.4:80", "[::1]:80"或"unix:/path"
+std::string get_peer_addr(int fd);
+std::string sockaddr_to_string(const struct sockaddr_storage& addr);
 unsigned int ipToInt(const char *ipstr);
 void int2ip( int ip_num, char *ip );
+//解析数字形式的IPv4/IPv6地址并填入端口, 不做域名解析
+//"unix:/path"解析为unix socket, "unix:@name"为Linux抽象命名空间, 忽略端口
+bool parse_sockaddr(const std::string& ip, int port, struct sockaddr_storage *addr);
+socklen_t sockaddr_len(const struct sockaddr_storage& addr);
 
 //时间处理函数
 long getCurrentTime();
@@ -32,5 +40,8 @@ std::map<std::string, std::string> getParamsMap(std::string queryString);
 std::vector<std::string> split(const std::string& str, std::string sep = ",");
 
 std::string hexdump(const void *buf, size_t len);
+
+//CRC32C(Castagnoli), crc为之前各段的结果, 可分段累计, 首段传0
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
 }
 #endif // UTIL_H
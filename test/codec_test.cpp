@@ -0,0 +1,112 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "codec.h"
+#include "tcpconnection.h"
+#include "eventloop.h"
+#include "logging.h"
+#include "check.h"
+
+namespace {
+
+void runFor(EventLoop *loop, int ms) {
+    struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+    event_base_loopexit(loop->getBase(), &tv);
+    event_base_dispatch(loop->getBase());
+}
+
+std::string frame(const LengthFieldCodec& codec, const std::string& body) {
+    unsigned char header[8];
+    codec.encodeLength(body.size(), header);
+    return std::string(reinterpret_cast<char *>(header), codec.headerLen()) + body;
+}
+
+void writeAll(int fd, const std::string& data) {
+    CHECK(::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+}
+
+//多个帧拼在一起, 再按任意位置切开分几次到达, 回调必须按原样逐帧交付
+void testSplit(int headerLen, LengthFieldCodec::Endian endian) {
+    EventLoop loop;
+    std::vector<std::string> frames;
+    LengthFieldCodec codec([&frames](const TcpConnPtr&, const char *data, size_t len) {
+        frames.push_back(std::string(data, len));
+    }, headerLen, endian);
+
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    TcpConnPtr conn = TcpConnection::create(&loop, fds[0], "codec");
+    conn->setMessageCallback(std::bind(&LengthFieldCodec::onMessage, &codec, std::placeholders::_1, std::placeholders::_2));
+
+    std::vector<std::string> bodies;
+    bodies.push_back("hello");
+    bodies.push_back("");
+    bodies.push_back(std::string(300, 'x'));
+    bodies.push_back(std::string(20000, 'y'));
+    std::string stream;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        stream += frame(codec, bodies[i]);
+    }
+
+    //第一段只有半个长度头, 之后每段都跨帧边界
+    size_t cuts[] = { 1, 7, 320, 5000, stream.size() };
+    size_t off = 0;
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); ++i) {
+        writeAll(fds[1], stream.substr(off, cuts[i] - off));
+        off = cuts[i];
+        runFor(&loop, 20);
+    }
+
+    CHECK(frames == bodies);
+    CHECK(conn->getBev() != NULL);
+    CHECK(evbuffer_get_length(bufferevent_get_input(conn->getBev())) == 0);
+
+    conn->close();
+    ::close(fds[1]);
+}
+
+//长度头超过上限时立刻关闭连接, 不等待body
+void testOversized() {
+    EventLoop loop;
+    int count = 0;
+    LengthFieldCodec codec([&count](const TcpConnPtr&, const char *, size_t) {
+        ++count;
+    }, 4, LengthFieldCodec::kBigEndian, 1024);
+
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    TcpConnPtr conn = TcpConnection::create(&loop, fds[0], "oversized");
+    bool closed = false;
+    conn->setCloseCallback([&closed](const TcpConnPtr&) {
+        closed = true;
+    });
+    conn->setMessageCallback(std::bind(&LengthFieldCodec::onMessage, &codec, std::placeholders::_1, std::placeholders::_2));
+
+    writeAll(fds[1], frame(codec, std::string(1024, 'a')));
+    std::string header = frame(codec, std::string(1025, 'b')).substr(0, 4);
+    writeAll(fds[1], header);
+    runFor(&loop, 50);
+
+    CHECK(count == 1);
+    CHECK(closed);
+    CHECK(conn->getBev() == NULL);
+
+    //发送端同样拒绝超长帧
+    TcpConnPtr sender = TcpConnection::create(&loop, fds[1], "sender");
+    CHECK(codec.send(sender, std::string(1025, 'c').data(), 1025) == -1);
+    sender->close();
+}
+
+}  // namespace
+
+int main() {
+    log_set_handler(LOGLVL_CRIT, log_stdout_simple, NULL, NULL);
+    testSplit(4, LengthFieldCodec::kBigEndian);
+    testSplit(2, LengthFieldCodec::kLittleEndian);
+    testSplit(8, LengthFieldCodec::kBigEndian);
+    testOversized();
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <set>
+#include <string>
+#include <vector>
+
+#include "eventloop.h"
+#include "connectiontable.h"
+#include "check.h"
+
+namespace {
+
+//连接必须关闭才会释放bufferevent, 全部记下来在最后统一关闭
+std::vector<TcpConnPtr> g_conns;
+
+TcpConnPtr newConn(EventLoop *loop, int i) {
+    g_conns.push_back(TcpConnection::create(loop, -1, "conn" + std::to_string(i)));
+    return g_conns.back();
+}
+
+//插入删除查找, id带分片号且互不相同
+void testInsertRemove(EventLoop *loop) {
+    ConnectionTable table(3);
+    std::vector<TcpConnPtr> conns;
+    std::vector<uint64_t> ids;
+    std::set<uint64_t> unique;
+    for (int i = 0; i < 100; ++i) {
+        conns.push_back(newConn(loop, i));
+        ids.push_back(table.insert(conns.back()));
+        unique.insert(ids.back());
+        CHECK(((ids.back() >> 32) & 0xff) == 3);
+    }
+    CHECK(unique.size() == 100);
+    CHECK(table.size() == 100);
+
+    for (int i = 0; i < 100; ++i) {
+        CHECK(table.find(ids[i]) == conns[i]);
+    }
+    for (int i = 0; i < 100; i += 2) {
+        CHECK(table.remove(ids[i]));
+        CHECK(!table.remove(ids[i]));
+        CHECK(!table.find(ids[i]));
+    }
+    CHECK(table.size() == 50);
+    for (int i = 1; i < 100; i += 2) {
+        CHECK(table.find(ids[i]) == conns[i]);
+    }
+
+    //分片号不同的id不会命中
+    CHECK(!table.find(ids[1] ^ (static_cast<uint64_t>(1) << 32)));
+    CHECK(!table.find(0xffffffff));
+}
+
+//slot被复用后旧id失效, 新id与旧id不同
+void testStaleId(EventLoop *loop) {
+    ConnectionTable table;
+    TcpConnPtr a = newConn(loop, 0);
+    TcpConnPtr b = newConn(loop, 1);
+    uint64_t idA = table.insert(a);
+    CHECK(table.remove(idA));
+    uint64_t idB = table.insert(b);
+    //复用同一个slot
+    CHECK((idA & 0xffffffff) == (idB & 0xffffffff));
+    CHECK(idA != idB);
+    CHECK(!table.find(idA));
+    CHECK(!table.remove(idA));
+    CHECK(table.find(idB) == b);
+    CHECK(table.size() == 1);
+}
+
+//遍历中删除当前或其他连接、插入新连接(复用空出的slot并触发扩容)都是安全的
+void testForEachModify(EventLoop *loop) {
+    ConnectionTable table;
+    std::vector<uint64_t> ids;
+    for (int i = 0; i < 4; ++i) {
+        ids.push_back(table.insert(newConn(loop, i)));
+    }
+
+    int visited = 0;
+    table.forEach([&](const TcpConnPtr& conn) {
+        if (visited++ == 0) {
+            CHECK(table.remove(ids[0]));
+            CHECK(table.remove(ids[1]));
+            //回调拿到的是拷贝, slot清空后仍然有效
+            CHECK(conn->getName() == "conn0");
+            for (int i = 0; i < 20; ++i) {
+                table.insert(newConn(loop, 100 + i));
+            }
+        }
+    });
+    //slot0, 复用的slot0/1中排在后面的slot1, 原来的slot2/3, 以及扩容出来的18个
+    CHECK(visited == 1 + 1 + 2 + 18);
+    CHECK(table.size() == 22);
+}
+
+}  // namespace
+
+int main() {
+    struct event_base *base = event_base_new();
+    {
+        EventLoop loop(base);
+        testInsertRemove(&loop);
+        testStaleId(&loop);
+        testForEachModify(&loop);
+        for (auto& conn : g_conns) {
+            conn->close();
+        }
+        g_conns.clear();
+        event_base_loop(base, EVLOOP_NONBLOCK);
+    }
+    event_base_free(base);
+    return 0;
+}
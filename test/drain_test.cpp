@@ -0,0 +1,150 @@
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "tcpserver.h"
+#include "logging.h"
+#include "check.h"
+
+namespace {
+
+const int kPort = 19952;
+
+typedef std::chrono::steady_clock Clock;
+
+struct DrainResult {
+    int clean;
+    int forced;
+    Clock::time_point at;
+};
+
+void runFor(struct event_base *base, int ms) {
+    struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+    event_base_loopexit(base, &tv);
+    event_base_dispatch(base);
+}
+
+int dial() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+//读到len字节或EOF, 超时返回-1
+int readWithTimeout(int fd, char *buf, size_t len, int timeoutMs) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeoutMs) != 1) {
+        return -1;
+    }
+    return static_cast<int>(read(fd, buf, len));
+}
+
+//发一个字节等回显, 确认连接已被worker接管
+void ping(int fd) {
+    char c = 'x';
+    CHECK(write(fd, &c, 1) == 1);
+    CHECK(readWithTimeout(fd, &c, 1, 2000) == 1);
+    CHECK(c == 'x');
+}
+
+//空闲时drain立即完成
+void testDrainIdle(TcpServer& server) {
+    std::promise<DrainResult> done;
+    server.drain(1, [&done](int clean, int forced) {
+        done.set_value(DrainResult{ clean, forced, Clock::now() });
+    });
+    std::future<DrainResult> f = done.get_future();
+    CHECK(f.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+    DrainResult r = f.get();
+    CHECK(r.clean == 0);
+    CHECK(r.forced == 0);
+}
+
+//收到EOF后关闭的连接计为clean, 超时仍未关闭的被强制关闭计为forced
+void testDrainTimeout(TcpServer& server) {
+    server.reStart();
+    std::vector<int> fds;
+    for (int i = 0; i < 4; ++i) {
+        fds.push_back(dial());
+        ping(fds.back());
+    }
+    CHECK(server.getConnectionNum() == 4);
+
+    std::promise<DrainResult> done;
+    Clock::time_point start = Clock::now();
+    server.drain(1, [&done](int clean, int forced) {
+        done.set_value(DrainResult{ clean, forced, Clock::now() });
+    });
+
+    //每个连接都先收到服务端的半关闭
+    char c;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        CHECK(readWithTimeout(fds[i], &c, 1, 2000) == 0);
+    }
+    //半关闭后仍可以继续发送
+    CHECK(write(fds[3], &c, 1) == 1);
+    close(fds[0]);
+    close(fds[1]);
+
+    std::future<DrainResult> f = done.get_future();
+    CHECK(f.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    DrainResult r = f.get();
+    CHECK(r.clean == 2);
+    CHECK(r.forced == 2);
+    //超时前不强制关闭
+    CHECK(r.at - start >= std::chrono::milliseconds(900));
+    CHECK(r.at - start < std::chrono::seconds(3));
+    CHECK(server.getConnectionNum() == 0);
+
+    //强制关闭后对端读到RST或EOF
+    CHECK(readWithTimeout(fds[2], &c, 1, 2000) <= 0);
+    close(fds[2]);
+    close(fds[3]);
+}
+
+}  // namespace
+
+int main() {
+    log_set_handler(LOGLVL_CRIT, log_stdout_simple, NULL, NULL);
+
+    struct event_base *base = event_base_new();
+    std::atomic<bool> quit(false);
+    std::thread serverThread;
+    {
+        TcpServer server(base);
+        server.setThreadNum(2);
+        server.setMessageCallback([](const TcpConnPtr& conn, struct evbuffer *buf) {
+            int len = static_cast<int>(evbuffer_get_length(buf));
+            conn->send(evbuffer_pullup(buf, len), len);
+            evbuffer_drain(buf, len);
+        });
+        CHECK(server.listen("127.0.0.1", kPort) == 0);
+        //监听base不支持跨线程loopbreak, 分段运行并检查退出标志
+        serverThread = std::thread([base, &quit]() {
+            while (!quit.load()) {
+                runFor(base, 20);
+            }
+        });
+
+        testDrainIdle(server);
+        testDrainTimeout(server);
+
+        quit.store(true);
+        serverThread.join();
+    }
+    event_base_free(base);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "eventloop.h"
+#include "logging.h"
+#include "check.h"
+
+namespace {
+
+//多个线程并发runInLoop, 每个生产者的任务按提交顺序执行且一个不丢
+void testCrossThreadOrdering(EventLoop *loop) {
+    const int kProducers = 4;
+    const int kTasks = 20000;
+    //只在loop线程内修改
+    std::vector<std::vector<int> > seen(kProducers);
+    std::promise<void> done;
+    int finished = 0;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.push_back(std::thread([loop, p, &seen, &done, &finished]() {
+            for (int i = 0; i < kTasks; ++i) {
+                loop->runInLoop([p, i, &seen]() {
+                    seen[p].push_back(i);
+                });
+            }
+            loop->runInLoop([&done, &finished]() {
+                if (++finished == kProducers) {
+                    done.set_value();
+                }
+            });
+        }));
+    }
+    for (auto& t : producers) {
+        t.join();
+    }
+    CHECK(done.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+
+    for (int p = 0; p < kProducers; ++p) {
+        CHECK(seen[p].size() == static_cast<size_t>(kTasks));
+        for (int i = 0; i < kTasks; ++i) {
+            CHECK(seen[p][i] == i);
+        }
+    }
+}
+
+//loop空闲阻塞在epoll里时逐个投递, 每个任务都必须唤醒loop, 丢一次唤醒就会超时
+void testWakeup(EventLoop *loop) {
+    for (int i = 0; i < 2000; ++i) {
+        std::promise<void> ran;
+        loop->queueInLoop([&ran]() {
+            ran.set_value();
+        });
+        CHECK(ran.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    }
+}
+
+//loop线程内runInLoop直接执行; 任务里再queueInLoop的任务留到下一轮, 但同样会被执行
+void testInLoop(EventLoop *loop) {
+    std::promise<void> done;
+    std::vector<int> order;
+    loop->queueInLoop([loop, &order, &done]() {
+        CHECK(loop->IsInLoopThread());
+        order.push_back(1);
+        loop->runInLoop([&order]() {
+            order.push_back(2);
+        });
+        loop->queueInLoop([&order, &done]() {
+            order.push_back(4);
+            done.set_value();
+        });
+        order.push_back(3);
+    });
+    CHECK(done.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(order.size() == 4);
+    for (int i = 0; i < 4; ++i) {
+        CHECK(order[i] == i + 1);
+    }
+}
+
+}  // namespace
+
+int main() {
+    log_set_handler(LOGLVL_ERROR, log_stdout_simple, NULL, NULL);
+    EventLoopThreadPool pool(1);
+    pool.start();
+    EventLoop *loop = pool.getLoop(0);
+    CHECK(!loop->IsInLoopThread());
+
+    testCrossThreadOrdering(loop);
+    testWakeup(loop);
+    testInLoop(loop);
+
+    pool.stop();
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <thread>
+#include <vector>
+
+#include "mempool.h"
+#include "check.h"
+
+namespace {
+
+void fill(void *p, size_t size, unsigned char seed) {
+    unsigned char *bytes = static_cast<unsigned char *>(p);
+    for (size_t i = 0; i < size; ++i) {
+        bytes[i] = static_cast<unsigned char>(seed + i);
+    }
+}
+
+bool verify(const void *p, size_t size, unsigned char seed) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(p);
+    for (size_t i = 0; i < size; ++i) {
+        if (bytes[i] != static_cast<unsigned char>(seed + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//各尺寸级的边界以及超过最大级的大块, 分配后可写满, 释放后同级再分配复用同一块
+void testSizeClasses() {
+    size_t sizes[] = { 0, 1, 16, 32, 33, 64, 1000, 4096, 4097, 65535, 65536, 65537, 1 << 20 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        size_t size = sizes[i];
+        void *p = MemPool::allocate(size);
+        CHECK(p != NULL);
+        CHECK(reinterpret_cast<uintptr_t>(p) % 16 == 0);
+        fill(p, size, static_cast<unsigned char>(i));
+        CHECK(verify(p, size, static_cast<unsigned char>(i)));
+        MemPool::deallocate(p);
+        if (size > 0 && size <= 65536) {
+            void *q = MemPool::allocate(size);
+            CHECK(q == p);
+            MemPool::deallocate(q);
+        }
+    }
+
+    MemPoolStats before = MemPool::getStats();
+    void *large = MemPool::allocate(65537);
+    MemPool::deallocate(large);
+    CHECK(MemPool::getStats().largeAllocs == before.largeAllocs + 1);
+}
+
+//同级内缩小/增长不搬迁, 跨级和大块时搬迁并保留内容
+void testReallocate() {
+    void *p = MemPool::reallocate(NULL, 40);
+    fill(p, 40, 7);
+    void *q = MemPool::reallocate(p, 64);
+    CHECK(q == p);
+    q = MemPool::reallocate(q, 10);
+    CHECK(q == p);
+    CHECK(verify(q, 10, 7));
+
+    q = MemPool::reallocate(q, 64);
+    CHECK(q == p);
+    fill(q, 64, 9);
+    void *r = MemPool::reallocate(q, 5000);
+    CHECK(r != q);
+    CHECK(verify(r, 64, 9));
+    void *s = MemPool::reallocate(r, 200000);
+    CHECK(verify(s, 64, 9));
+    void *t = MemPool::reallocate(s, 100);
+    CHECK(verify(t, 64, 9));
+    CHECK(MemPool::reallocate(t, 0) == NULL);
+}
+
+//不是本池分配的指针交给malloc系列处理, 不能混进空闲链表
+//检查块头要读指针前16字节, sanitizer的分配器不保证这部分可读, 只在普通构建下测试
+void testForeignPointer() {
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+    return;
+#endif
+    void *p = malloc(64);
+    memset(p, 0, 64);
+    MemPool::deallocate(p);
+
+    void *q = malloc(32);
+    fill(q, 32, 3);
+    q = MemPool::reallocate(q, 4096);
+    CHECK(verify(q, 32, 3));
+    MemPool::deallocate(q);
+
+    void *a = MemPool::allocate(64);
+    void *b = MemPool::allocate(64);
+    CHECK(a != b);
+    MemPool::deallocate(a);
+    MemPool::deallocate(b);
+}
+
+//一个线程分配、另一个线程释放, 分配线程退出后块仍然有效, 最终回到全局池继续使用
+void testCrossThread() {
+    const int kCount = 5000;
+    std::vector<void *> blocks(kCount);
+    std::thread producer([&blocks]() {
+        for (int i = 0; i < kCount; ++i) {
+            size_t size = 32 + (i % 7) * 500;
+            blocks[i] = MemPool::allocate(size);
+            CHECK(blocks[i] != NULL);
+            fill(blocks[i], size, static_cast<unsigned char>(i));
+        }
+    });
+    producer.join();
+
+    std::thread consumer([&blocks]() {
+        for (int i = 0; i < kCount; ++i) {
+            size_t size = 32 + (i % 7) * 500;
+            CHECK(verify(blocks[i], size, static_cast<unsigned char>(i)));
+            MemPool::deallocate(blocks[i]);
+        }
+    });
+    consumer.join();
+
+    //consumer退出时缓存的块已还给全局池, 再分配同样数量不需要新的chunk
+    uint64_t reserved = MemPool::getStats().reservedBytes;
+    std::thread again([&blocks]() {
+        for (int i = 0; i < kCount; ++i) {
+            blocks[i] = MemPool::allocate(32 + (i % 7) * 500);
+        }
+        for (int i = 0; i < kCount; ++i) {
+            MemPool::deallocate(blocks[i]);
+        }
+    });
+    again.join();
+    CHECK(MemPool::getStats().reservedBytes == reserved);
+}
+
+}  // namespace
+
+int main() {
+    testSizeClasses();
+    testReallocate();
+    testForeignPointer();
+    testCrossThread();
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "tcpserver.h"
+#include "logging.h"
+#include "check.h"
+
+namespace {
+
+const int kPort = 19953;
+
+void runFor(struct event_base *base, int ms) {
+    struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+    event_base_loopexit(base, &tv);
+    event_base_dispatch(base);
+}
+
+int dial() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+void ping(int fd) {
+    char c = 'x';
+    CHECK(write(fd, &c, 1) == 1);
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    CHECK(poll(&pfd, 1, 2000) == 1);
+    CHECK(read(fd, &c, 1) == 1);
+    CHECK(c == 'x');
+}
+
+bool waitConnectionNum(TcpServer& server, int num) {
+    for (int i = 0; i < 100 && server.getConnectionNum() != num; ++i) {
+        usleep(20000);
+    }
+    return server.getConnectionNum() == num;
+}
+
+}  // namespace
+
+//每个worker各自监听同一端口, 由内核分发连接; 监听base本身不参与accept
+int main() {
+    log_set_handler(LOGLVL_CRIT, log_stdout_simple, NULL, NULL);
+
+    struct event_base *base = event_base_new();
+    std::atomic<bool> quit(false);
+    std::thread serverThread;
+    {
+        std::mutex mutex;
+        std::set<std::thread::id> workers;
+        TcpServer server(base);
+        server.setThreadNum(3);
+        server.setReusePort(true);
+        server.setMessageCallback([&mutex, &workers](const TcpConnPtr& conn, struct evbuffer *buf) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                workers.insert(std::this_thread::get_id());
+            }
+            int len = static_cast<int>(evbuffer_get_length(buf));
+            conn->send(evbuffer_pullup(buf, len), len);
+            evbuffer_drain(buf, len);
+        });
+        CHECK(server.listen("127.0.0.1", kPort) == 0);
+        //监听base不支持跨线程loopbreak, 分段运行并检查退出标志
+        serverThread = std::thread([base, &quit]() {
+            while (!quit.load()) {
+                runFor(base, 20);
+            }
+        });
+
+        std::vector<int> fds;
+        for (int i = 0; i < 32; ++i) {
+            fds.push_back(dial());
+            ping(fds.back());
+        }
+        CHECK(waitConnectionNum(server, 32));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            //按四元组哈希分发, 32个连接全部落在同一个worker的概率可以忽略
+            CHECK(workers.size() >= 2);
+            CHECK(workers.count(serverThread.get_id()) == 0);
+        }
+
+        for (size_t i = 0; i < fds.size(); ++i) {
+            close(fds[i]);
+        }
+        CHECK(waitConnectionNum(server, 0));
+
+        //stop之后各worker的监听都停止accept, 已连接的请求不会再被处理
+        server.stop();
+        usleep(50000);
+        int fd = dial();
+        char c = 'x';
+        CHECK(write(fd, &c, 1) == 1);
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        CHECK(poll(&pfd, 1, 200) == 0);
+        close(fd);
+
+        quit.store(true);
+        serverThread.join();
+    }
+    event_base_free(base);
+    return 0;
+}
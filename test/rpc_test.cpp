@@ -0,0 +1,218 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tcpserver.h"
+#include "rpcclient.h"
+#include "codec.h"
+#include "logging.h"
+#include "check.h"
+
+namespace {
+
+const int kPort = 19951;
+
+void runFor(struct event_base *base, int ms) {
+    struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+    event_base_loopexit(base, &tv);
+    event_base_dispatch(base);
+}
+
+//服务端: "drop"不回复, "kill"直接断开连接, 其他原样回复
+void onRequest(const TcpConnPtr& conn, const char *data, size_t len) {
+    uint64_t id;
+    if (!RpcClient::parseFrame(data, len, &id)) {
+        return;
+    }
+    std::string payload(data + 8, len - 8);
+    if (payload == "drop") {
+        return;
+    }
+    if (payload == "kill") {
+        conn->close();
+        return;
+    }
+    RpcClient::sendFrame(conn, id, payload.data(), payload.size());
+}
+
+struct Result {
+    int ok;
+    int timeout;
+    int disconnected;
+    std::vector<std::string> order;
+
+    Result() : ok(0), timeout(0), disconnected(0) {}
+
+    RpcClient::ResponseCallBack track(const std::string& tag) {
+        return [this, tag](RpcClient::Status status, const char *data, size_t len) {
+            order.push_back(tag);
+            if (status == RpcClient::kOk) {
+                CHECK(std::string(data, len) == tag);
+                ++ok;
+            } else if (status == RpcClient::kTimeout) {
+                CHECK(data == NULL);
+                ++timeout;
+            } else {
+                CHECK(data == NULL);
+                ++disconnected;
+            }
+        };
+    }
+};
+
+bool connect(RpcClient& rpc, struct event_base *base) {
+    rpc.connect("127.0.0.1", kPort);
+    for (int i = 0; i < 50 && !rpc.isConnected(); ++i) {
+        runFor(base, 20);
+    }
+    return rpc.isConnected();
+}
+
+//未连接时call不发送也不回调
+void testNotConnected(struct event_base *base) {
+    RpcClient rpc(base, "rpc", 0);
+    Result r;
+    CHECK(rpc.call("x", 1, 100, r.track("x")) == 0);
+    CHECK(rpc.getPendingCount() == 0);
+    CHECK(r.order.empty());
+}
+
+//无响应的请求按截止时间先后超时, 取消的请求不回调, 正常请求不受影响
+void testTimeout(struct event_base *base) {
+    RpcClient rpc(base, "rpc", 0);
+    CHECK(connect(rpc, base));
+
+    Result r;
+    CHECK(rpc.call("drop", 4, 150, r.track("late")) != 0);
+    CHECK(rpc.call("drop", 4, 50, r.track("early")) != 0);
+    uint64_t cancelled = rpc.call("drop", 4, 60, r.track("cancelled"));
+    CHECK(rpc.cancel(cancelled));
+    CHECK(!rpc.cancel(cancelled));
+    CHECK(rpc.call("hello", 5, 1000, r.track("hello")) != 0);
+    CHECK(rpc.call("drop", 4, 0, r.track("forever")) != 0);
+
+    runFor(base, 100);
+    CHECK(r.ok == 1);
+    CHECK(r.timeout == 1);
+    CHECK(rpc.getPendingCount() == 2);
+
+    runFor(base, 150);
+    CHECK(r.timeout == 2);
+    CHECK(r.order.size() == 3);
+    CHECK(r.order[0] == "hello");
+    CHECK(r.order[1] == "early");
+    CHECK(r.order[2] == "late");
+    //不设截止时间的请求一直等待
+    CHECK(rpc.getPendingCount() == 1);
+
+    //close时剩余请求以kDisconnected失败
+    rpc.close();
+    CHECK(r.disconnected == 1);
+    CHECK(r.order.back() == "forever");
+    CHECK(rpc.getPendingCount() == 0);
+}
+
+//大量请求完成后堆中只剩过期条目, 不影响之后的超时
+void testManyCompleted(struct event_base *base) {
+    RpcClient rpc(base, "rpc", 0);
+    CHECK(connect(rpc, base));
+
+    Result r;
+    for (int i = 0; i < 2000; ++i) {
+        std::string tag = std::to_string(i);
+        CHECK(rpc.call(tag.data(), tag.size(), 5000, r.track(tag)) != 0);
+    }
+    for (int i = 0; i < 50 && r.ok < 2000; ++i) {
+        runFor(base, 20);
+    }
+    CHECK(r.ok == 2000);
+    CHECK(rpc.getPendingCount() == 0);
+
+    CHECK(rpc.call("drop", 4, 30, r.track("drop")) != 0);
+    runFor(base, 100);
+    CHECK(r.timeout == 1);
+    CHECK(rpc.getPendingCount() == 0);
+}
+
+//服务端断开时所有在途请求立即失败, 之后收不到任何回调
+void testDisconnect(struct event_base *base) {
+    RpcClient rpc(base, "rpc", 0);
+    CHECK(connect(rpc, base));
+
+    Result r;
+    int closed = 0;
+    rpc.setCloseCallback([&closed, &rpc](const TcpConnPtr&) {
+        CHECK(rpc.getPendingCount() == 0);
+        ++closed;
+    });
+    for (int i = 0; i < 3; ++i) {
+        CHECK(rpc.call("drop", 4, 0, r.track("drop")) != 0);
+    }
+    CHECK(rpc.call("drop", 4, 5000, r.track("deadline")) != 0);
+    CHECK(rpc.call("kill", 4, 0, r.track("kill")) != 0);
+
+    for (int i = 0; i < 50 && closed == 0; ++i) {
+        runFor(base, 20);
+    }
+    CHECK(closed == 1);
+    CHECK(r.disconnected == 5);
+    CHECK(r.ok == 0);
+    CHECK(r.timeout == 0);
+    CHECK(rpc.getPendingCount() == 0);
+
+    //截止时间的定时器已随连接失效
+    runFor(base, 100);
+    CHECK(r.order.size() == 5);
+}
+
+//析构时在途请求以kDisconnected回调
+void testDestroy(struct event_base *base) {
+    Result r;
+    {
+        RpcClient rpc(base, "rpc", 0);
+        CHECK(connect(rpc, base));
+        CHECK(rpc.call("drop", 4, 1000, r.track("drop")) != 0);
+    }
+    CHECK(r.disconnected == 1);
+    runFor(base, 50);
+    CHECK(r.order.size() == 1);
+}
+
+}  // namespace
+
+int main() {
+    log_set_handler(LOGLVL_CRIT, log_stdout_simple, NULL, NULL);
+
+    struct event_base *serverBase = event_base_new();
+    std::atomic<bool> quit(false);
+    std::thread serverThread;
+    {
+        TcpServer server(serverBase);
+        server.setThreadNum(1);
+        LengthFieldCodec codec(onRequest);
+        server.setMessageCallback(std::bind(&LengthFieldCodec::onMessage, &codec,
+                                            std::placeholders::_1, std::placeholders::_2));
+        CHECK(server.listen("127.0.0.1", kPort) == 0);
+        //监听base不支持跨线程loopbreak, 分段运行并检查退出标志
+        serverThread = std::thread([serverBase, &quit]() {
+            while (!quit.load()) {
+                runFor(serverBase, 20);
+            }
+        });
+
+        struct event_base *base = event_base_new();
+        testNotConnected(base);
+        testTimeout(base);
+        testManyCompleted(base);
+        testDisconnect(base);
+        testDestroy(base);
+        runFor(base, 50);
+        event_base_free(base);
+
+        quit.store(true);
+        serverThread.join();
+    }
+    event_base_free(serverBase);
+    return 0;
+}
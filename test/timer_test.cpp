@@ -0,0 +1,82 @@
+#include "timer.h"
+#include "check.h"
+
+namespace {
+
+void runFor(struct event_base *base, int ms) {
+    struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+    event_base_loopexit(base, &tv);
+    event_base_dispatch(base);
+}
+
+//构造时启动的一次性定时器, 触发后可以再次add
+void testTemporaryReAdd(struct event_base *base) {
+    int fired = 0;
+    Timer timer(base, 0, [&fired]() {
+        ++fired;
+    }, true);
+    runFor(base, 50);
+    CHECK(fired == 1);
+
+    timer.addMilliseconds(10);
+    runFor(base, 100);
+    CHECK(fired == 2);
+
+    timer.add(0);
+    runFor(base, 50);
+    CHECK(fired == 3);
+}
+
+//等待中的构造定时器add无效, stop之后可以按新的时间重新add
+void testStopThenAdd(struct event_base *base) {
+    int fired = 0;
+    Timer timer(base, 10, [&fired]() {
+        ++fired;
+    }, true);
+    timer.addMilliseconds(10);
+    runFor(base, 100);
+    CHECK(fired == 0);
+
+    timer.stop();
+    timer.addMilliseconds(10);
+    runFor(base, 100);
+    CHECK(fired == 1);
+}
+
+//周期定时器stop后再add, 按新的间隔继续
+void testPersistStopThenAdd(struct event_base *base) {
+    int fired = 0;
+    Timer timer(base, 10, [&fired]() {
+        ++fired;
+    });
+    timer.stop();
+    timer.addMilliseconds(20);
+    runFor(base, 110);
+    CHECK(fired >= 3);
+    timer.stop();
+}
+
+//未在构造时启动的定时器, 重复add按最后一次的时间触发
+void testReschedule(struct event_base *base) {
+    int fired = 0;
+    Timer timer(base, [&fired]() {
+        ++fired;
+    });
+    timer.addMilliseconds(10);
+    timer.addMilliseconds(500);
+    runFor(base, 100);
+    CHECK(fired == 0);
+    timer.stop();
+}
+
+}  // namespace
+
+int main() {
+    struct event_base *base = event_base_new();
+    testTemporaryReAdd(base);
+    testStopThenAdd(base);
+    testPersistStopThenAdd(base);
+    testReschedule(base);
+    event_base_free(base);
+    return 0;
+}
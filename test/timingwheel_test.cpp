@@ -0,0 +1,72 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <map>
+
+#include "timingwheel.h"
+#include "tcpconnection.h"
+#include "eventloop.h"
+#include "logging.h"
+#include "check.h"
+
+namespace {
+
+std::map<std::string, int> closed;
+
+TcpConnPtr newConn(EventLoop *loop, const char *name, int idleTimeout, int *peer) {
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    *peer = fds[1];
+    TcpConnPtr conn = TcpConnection::create(loop, fds[0], name);
+    conn->setTimingWheelOpt(false, 0, idleTimeout);
+    conn->setCloseCallback([](const TcpConnPtr& c) {
+        ++closed[c->getName()];
+    });
+    return conn;
+}
+
+void runFor(EventLoop *loop, int ms) {
+    struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+    event_base_loopexit(loop->getBase(), &tv);
+    event_base_dispatch(loop->getBase());
+}
+
+}  // namespace
+
+int main() {
+    log_set_handler(LOGLVL_ERROR, log_stdout_simple, NULL, NULL);
+    EventLoop loop;
+    TimingWheel wheel(loop.getBase(), 8);
+
+    int peers[4];
+    TcpConnPtr idle = newConn(&loop, "idle", 1, &peers[0]);
+    TcpConnPtr cancelled = newConn(&loop, "cancelled", 1, &peers[1]);
+    TcpConnPtr later = newConn(&loop, "later", 30, &peers[2]);
+    TcpConnPtr none = newConn(&loop, "none", 0, &peers[3]);
+    wheel.add(idle);
+    wheel.add(cancelled);
+    wheel.add(later);
+    wheel.add(none);
+    //没有心跳也没有空闲超时的连接不挂到时间轮上
+    CHECK(wheel.size() == 3);
+
+    //到期前关闭的连接, 扫到它的桶时直接丢弃, 不会再被踢一次
+    cancelled->close();
+    CHECK(closed["cancelled"] == 1);
+
+    runFor(&loop, 3000);
+
+    CHECK(closed["idle"] == 1);
+    CHECK(idle->getBev() == NULL);
+    CHECK(closed["cancelled"] == 1);
+    CHECK(closed["later"] == 0);
+    CHECK(later->getBev() != NULL);
+    CHECK(wheel.size() == 1);
+
+    later->close();
+    none->close();
+    for (int i = 0; i < 4; ++i) {
+        ::close(peers[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <stddef.h>
+#include <string.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "util.h"
+#include "check.h"
+
+namespace {
+
+void testIPv4() {
+    struct sockaddr_storage addr;
+    CHECK(util::parse_sockaddr("127.0.0.1", 8080, &addr));
+    const struct sockaddr_in *in = (const struct sockaddr_in *)&addr;
+    CHECK(in->sin_family == AF_INET);
+    CHECK(ntohs(in->sin_port) == 8080);
+    CHECK(in->sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    CHECK(util::sockaddr_len(addr) == sizeof(struct sockaddr_in));
+    CHECK(util::sockaddr_to_string(addr) == "127.0.0.1:8080");
+}
+
+void testIPv6() {
+    struct sockaddr_storage addr;
+    const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)&addr;
+    CHECK(util::parse_sockaddr("[::1]", 9000, &addr));
+    CHECK(in6->sin6_family == AF_INET6);
+    CHECK(ntohs(in6->sin6_port) == 9000);
+    CHECK(memcmp(&in6->sin6_addr, &in6addr_loopback, sizeof(in6addr_loopback)) == 0);
+    CHECK(util::sockaddr_len(addr) == sizeof(struct sockaddr_in6));
+    CHECK(util::sockaddr_to_string(addr) == "[::1]:9000");
+
+    //不带方括号同样可以
+    CHECK(util::parse_sockaddr("fe80::1", 9000, &addr));
+    CHECK(in6->sin6_family == AF_INET6);
+}
+
+void testUnix() {
+    struct sockaddr_storage addr;
+    const struct sockaddr_un *un = (const struct sockaddr_un *)&addr;
+    CHECK(util::parse_sockaddr("unix:/tmp/evnet.sock", 80, &addr));
+    CHECK(un->sun_family == AF_UNIX);
+    CHECK(strcmp(un->sun_path, "/tmp/evnet.sock") == 0);
+    CHECK(util::sockaddr_len(addr) == sizeof(struct sockaddr_un));
+    CHECK(util::sockaddr_to_string(addr) == "unix:/tmp/evnet.sock");
+}
+
+void testAbstract() {
+    struct sockaddr_storage addr;
+    const struct sockaddr_un *un = (const struct sockaddr_un *)&addr;
+    CHECK(util::parse_sockaddr("unix:@evnet", 0, &addr));
+    CHECK(un->sun_family == AF_UNIX);
+    CHECK(un->sun_path[0] == '\0');
+    CHECK(memcmp(un->sun_path + 1, "evnet", 5) == 0);
+    //抽象名字的长度不含结尾的'\0'
+    CHECK(util::sockaddr_len(addr) == offsetof(struct sockaddr_un, sun_path) + 1 + 5);
+    CHECK(util::sockaddr_to_string(addr) == "unix:@evnet");
+}
+
+void testInvalid() {
+    struct sockaddr_storage addr;
+    CHECK(!util::parse_sockaddr("", 80, &addr));
+    CHECK(!util::parse_sockaddr("localhost", 80, &addr));
+    CHECK(!util::parse_sockaddr("1.2.3.256", 80, &addr));
+    CHECK(!util::parse_sockaddr("[::1", 80, &addr));
+    CHECK(!util::parse_sockaddr("unix:", 80, &addr));
+    CHECK(!util::parse_sockaddr("unix:/" + std::string(sizeof(((struct sockaddr_un *)0)->sun_path), 'a'), 80, &addr));
+}
+
+}  // namespace
+
+int main() {
+    testIPv4();
+    testIPv6();
+    testUnix();
+    testAbstract();
+    testInvalid();
+    return 0;
+}